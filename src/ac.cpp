@@ -0,0 +1,186 @@
+#include "ac.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+
+#include "lu.h"
+
+using namespace std;
+
+// an entry of the system that grows with frequency, value * j * omega
+struct ReactiveStamp
+{
+    int row;
+    int column;
+    double value;
+};
+
+// capacitors stamp j omega C like a conductance, inductors put -j omega L on
+// the diagonal of their branch row
+static vector<ReactiveStamp> findReactiveStamps(const Circuit &circuit)
+{
+    vector<ReactiveStamp> stamps;
+    for (const tuple<int, int, double> &capacitor : circuit.capacitors)
+    {
+        int i = get<0>(capacitor);
+        int j = get<1>(capacitor);
+        double C = get<2>(capacitor);
+
+        if (i != 0)
+            stamps.push_back({i - 1, i - 1, C});
+        if (j != 0)
+            stamps.push_back({j - 1, j - 1, C});
+        if (i != 0 && j != 0)
+        {
+            stamps.push_back({i - 1, j - 1, -C});
+            stamps.push_back({j - 1, i - 1, -C});
+        }
+    }
+
+    int row = circuit.nodeVoltages.size() - 1 + circuit.batteries.size();
+    for (const tuple<int, int, double> &inductor : circuit.inductors)
+    {
+        stamps.push_back({row, row, -get<2>(inductor)});
+        row++;
+    }
+    return stamps;
+}
+
+AcSweep::AcSweep(const Circuit &circuit, int source, const vector<double> &frequencies, unsigned int numThreads)
+    : frequencies(frequencies)
+{
+    if (source < 0 || source >= (int)circuit.batteries.size())
+        throw invalid_argument("voltage source " + to_string(source + 1) + " does not exist");
+    if (!circuit.subcircuits.empty())
+        throw invalid_argument("subcircuits are reduced for DC only and cannot be swept in frequency");
+    if (circuit.isOutOfCore())
+        throw logic_error("the conductance matrix was factored out of core and not kept");
+
+    int numNodes = circuit.nodeVoltages.size();
+    int systemSize = circuit.getSystemSize();
+    int numPoints = frequencies.size();
+
+    // the real part never changes, the DC matrix already has the resistors,
+    // sources and inductor branch rows, and the ties of its floating nodes
+    // are taken out
+    vector<vector<complex<double>>> base(systemSize, vector<complex<double>>(systemSize));
+    {
+        vector<vector<double>> G = circuit.getConductanceMatrix();
+        for (int i = 0; i < systemSize; i++)
+        {
+            for (int j = 0; j < systemSize; j++)
+                base[i][j] = G[i][j];
+        }
+    }
+    for (int node : circuit.getFloatingNodes())
+        base[node - 1][node - 1] -= 1.0;
+    vector<ReactiveStamp> stamps = findReactiveStamps(circuit);
+
+    vector<complex<double>> rhs(systemSize);
+    int inputRow = numNodes - 1 + source;
+    rhs[inputRow] = 1.0;
+
+    nodeVoltages.assign(numNodes, vector<complex<double>>(numPoints));
+    inputCurrents.assign(numPoints, 0.0);
+
+    // every point writes only its own column of the results
+    atomic<int> nextPoint(0);
+    auto solvePoints = [&]() {
+        vector<vector<complex<double>>> A;
+        for (int point = nextPoint++; point < numPoints; point = nextPoint++)
+        {
+            double omega = 2 * M_PI * this->frequencies[point];
+            A = base;
+            for (const ReactiveStamp &stamp : stamps)
+                A[stamp.row][stamp.column] += complex<double>(0, omega * stamp.value);
+
+            vector<complex<double>> x = ComplexLUFactorization(A).solve(rhs);
+            for (int node = 1; node < numNodes; node++)
+                nodeVoltages[node][point] = x[node - 1];
+            inputCurrents[point] = x[inputRow];
+        }
+    };
+
+    if (numThreads == 0)
+        numThreads = max(1u, thread::hardware_concurrency());
+    numThreads = min(numThreads, (unsigned int)max(numPoints, 1));
+
+    vector<thread> workers;
+    for (unsigned int i = 1; i < numThreads; i++)
+        workers.emplace_back(solvePoints);
+    solvePoints();
+    for (thread &worker : workers)
+        worker.join();
+}
+
+vector<double> AcSweep::logarithmicFrequencies(double start, double stop, int numPoints)
+{
+    vector<double> frequencies;
+    if (numPoints == 1)
+        return vector<double>(1, start);
+
+    double ratio = log(stop / start) / (numPoints - 1);
+    for (int i = 0; i < numPoints; i++)
+        frequencies.push_back(start * exp(ratio * i));
+    return frequencies;
+}
+
+// the source current flows into its positive terminal, so the circuit draws
+// the negative of it
+complex<double> AcSweep::getInputImpedance(int point) const
+{
+    return -1.0 / inputCurrents[point];
+}
+
+static void writeUint32(ostream &out, uint32_t value)
+{
+    out.write((const char *)&value, sizeof(value));
+}
+
+static void writeColumnName(ostream &out, const string &name)
+{
+    writeUint32(out, name.size());
+    out.write(name.data(), name.size());
+}
+
+static void writeColumn(ostream &out, const vector<double> &column)
+{
+    out.write((const char *)column.data(), column.size() * sizeof(double));
+}
+
+void AcSweep::write(ostream &out) const
+{
+    int numPoints = frequencies.size();
+    int numNodes = nodeVoltages.size();
+
+    out.write("CAAC", 4);
+    writeUint32(out, 1);
+    writeUint32(out, numPoints);
+    writeUint32(out, 1 + 2 * (numNodes - 1) + 2);
+
+    writeColumnName(out, "frequency");
+    for (int node = 1; node < numNodes; node++)
+    {
+        writeColumnName(out, "re(V(" + to_string(node) + "))");
+        writeColumnName(out, "im(V(" + to_string(node) + "))");
+    }
+    writeColumnName(out, "re(I(input))");
+    writeColumnName(out, "im(I(input))");
+
+    writeColumn(out, frequencies);
+    vector<double> real(numPoints), imaginary(numPoints);
+    for (int node = 1; node <= numNodes; node++)
+    {
+        const vector<complex<double>> &values = node < numNodes ? nodeVoltages[node] : inputCurrents;
+        for (int point = 0; point < numPoints; point++)
+        {
+            real[point] = values[point].real();
+            imaginary[point] = values[point].imag();
+        }
+        writeColumn(out, real);
+        writeColumn(out, imaginary);
+    }
+}
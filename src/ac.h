@@ -0,0 +1,52 @@
+#ifndef AC_H
+#define AC_H
+
+#include <complex>
+#include <iostream>
+#include <vector>
+
+#include "circuit.h"
+
+using namespace std;
+
+// Small-signal frequency sweep of a circuit with capacitors and inductors.
+//
+// One voltage source (the input) is driven with an amplitude of 1 V and zero
+// phase while every other source is shorted, so the node voltages are the
+// transfer functions from the input and the input current gives the
+// impedance the source sees.
+//
+// The sweep is set up once: the frequency-independent part of the complex
+// system and the positions every C and L stamp into are found before any
+// frequency is solved. Each frequency point only fills in those positions and
+// factors its own copy, so the points are spread over all cores.
+struct AcSweep
+{
+    vector<double> frequencies;
+
+    // nodeVoltages[node][point], node 0 is ground
+    vector<vector<complex<double>>> nodeVoltages;
+
+    // current through the input source at each point
+    vector<complex<double>> inputCurrents;
+
+    // source is the voltage source number (0 based), numThreads 0 uses every
+    // core. Throws invalid_argument if there is no such source, or if the
+    // circuit has subcircuit instances, which are reduced for DC only, and
+    // logic_error for a circuit solved out of core
+    AcSweep(const Circuit &circuit, int source, const vector<double> &frequencies, unsigned int numThreads = 0);
+
+    // points evenly spaced on a log scale from start to stop inclusive
+    static vector<double> logarithmicFrequencies(double start, double stop, int numPoints);
+
+    // impedance seen by the input source at a point
+    complex<double> getInputImpedance(int point) const;
+
+    // binary columnar file: "CAAC", then uint32 version, point count and
+    // column count, then each column's name (uint32 length and bytes), then
+    // each column as point count doubles. Columns are the frequency, the real
+    // and imaginary part of every node voltage and of the input current
+    void write(ostream &out) const;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "arena.h"
+
+using namespace std;
+
+LoadArena::LoadArena(size_t initialSize)
+    : capacity(initialSize), buffer(new char[initialSize]),
+      arena(new pmr::monotonic_buffer_resource(buffer.get(), capacity, &overflow))
+{
+}
+
+pmr::memory_resource *LoadArena::resource()
+{
+    return arena.get();
+}
+
+void LoadArena::release()
+{
+    arena->release();
+    if (overflow.bytes == 0)
+        return;
+
+    // the last load did not fit, make room for all of it next time
+    capacity += overflow.bytes;
+    overflow.bytes = 0;
+    arena.reset();
+    buffer.reset(new char[capacity]);
+    arena.reset(new pmr::monotonic_buffer_resource(buffer.get(), capacity, &overflow));
+}
+
+size_t LoadArena::getCapacity() const
+{
+    return capacity;
+}
+
+void *LoadArena::Overflow::do_allocate(size_t size, size_t alignment)
+{
+    bytes += size;
+    return pmr::new_delete_resource()->allocate(size, alignment);
+}
+
+void LoadArena::Overflow::do_deallocate(void *p, size_t size, size_t alignment)
+{
+    pmr::new_delete_resource()->deallocate(p, size, alignment);
+}
+
+bool LoadArena::Overflow::do_is_equal(const pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
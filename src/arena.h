@@ -0,0 +1,58 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+using namespace std;
+
+// Memory for the temporaries of parsing a netlist: the list of netlist lines
+// still to be parsed and the subcircuit library (definitions, reduced models
+// and the names being reduced).
+//
+// Dense matrices stay on the heap, including those of a load that only live
+// as long as it, such as the matrix of a subcircuit body and the factored
+// block its port model eliminates. The buffer keeps the size of the largest
+// load it has seen, so an n x n matrix here would stay allocated for as long
+// as the loading thread does.
+//
+// Allocations are bumped out of one buffer and never freed individually;
+// release() frees all of them at once and keeps the buffer for the next load.
+// Whatever does not fit comes from the heap, and the buffer is then enlarged
+// on release so that repeated loads of similar netlists settle on a single
+// buffer and no allocator calls. Nothing allocated from the arena may outlive
+// release(). Not thread safe, use one arena per loading thread.
+class LoadArena
+{
+public:
+    LoadArena(size_t initialSize = 64 << 10);
+
+    pmr::memory_resource *resource();
+
+    // free everything allocated since the last release
+    void release();
+
+    // bytes a load can use before falling back to the heap
+    size_t getCapacity() const;
+
+private:
+    // heap memory taken once the buffer is full, counted to size the next buffer
+    class Overflow : public pmr::memory_resource
+    {
+    public:
+        size_t bytes = 0;
+
+    private:
+        void *do_allocate(size_t size, size_t alignment) override;
+        void do_deallocate(void *p, size_t size, size_t alignment) override;
+        bool do_is_equal(const pmr::memory_resource &other) const noexcept override;
+    };
+
+    size_t capacity;
+    unique_ptr<char[]> buffer;
+    Overflow overflow;
+    unique_ptr<pmr::monotonic_buffer_resource> arena;
+};
+
+#endif
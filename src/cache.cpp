@@ -0,0 +1,182 @@
+#include "cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+using namespace std;
+
+// rough number of bytes a solved circuit can hold. The results derived on
+// first use are counted up front as if they were built, since an entry is
+// only counted when it is added
+static size_t estimateSize(const Circuit &circuit)
+{
+    size_t numNodes = circuit.nodeVoltages.size();
+    size_t numComponents =
+        circuit.batteries.size() + circuit.resistors.size() + circuit.capacitors.size() + circuit.inductors.size();
+
+    size_t size = sizeof(Circuit);
+    size += numComponents * sizeof(tuple<int, int, double>);
+    size += (numNodes + circuit.sourceCurrents.size() + circuit.inductorCurrents.size()) * sizeof(double);
+
+    size += circuit.sourceVector.size() * sizeof(double);
+
+    // a reload's earlier factors are counted with every circuit sharing them
+    size += circuit.getFactorizationBytes();
+
+    // resistor currents and the currents and voltages by name (a map node per
+    // entry); the branch incidence matrix is only built for debug printing
+    size += circuit.resistors.size() * sizeof(double);
+    size += (numComponents + numNodes) * (sizeof(pair<const string, double>) + 4 * sizeof(void *));
+    return size;
+}
+
+CircuitCache::CircuitCache(size_t memoryBudget, const string &directory)
+    : memoryBudget(memoryBudget), memoryUsage(0), directory(directory)
+{
+}
+
+// 64-bit FNV-1a hash of the contents followed by their length
+string CircuitCache::hashNetlist(const string &contents)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : contents)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    char key[40];
+    snprintf(key, sizeof(key), "%016llx-%llx", (unsigned long long)hash, (unsigned long long)contents.size());
+    return key;
+}
+
+circuitHandle CircuitCache::find(const string &netlist)
+{
+    string key = hashNetlist(netlist);
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = index.find(key);
+        if (it != index.end())
+        {
+            // the same hash from a different netlist is a miss
+            if (it->second->netlist != netlist)
+                return nullptr;
+
+            // move to the front of the LRU list
+            entries.splice(entries.begin(), entries, it->second);
+            return it->second->circuit;
+        }
+    }
+
+    if (directory.empty())
+        return nullptr;
+
+    circuitHandle circuit = readFromDisk(key, netlist);
+    if (circuit != nullptr)
+    {
+        lock_guard<mutex> guard(lock);
+        if (index.find(key) == index.end())
+            addEntry(key, netlist, circuit);
+    }
+    return circuit;
+}
+
+circuitHandle CircuitCache::insert(const string &netlist, circuitHandle circuit)
+{
+    string key = hashNetlist(netlist);
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = index.find(key);
+        if (it != index.end())
+        {
+            if (it->second->netlist == netlist)
+            {
+                // someone else solved the same netlist first, share theirs
+                entries.splice(entries.begin(), entries, it->second);
+                return it->second->circuit;
+            }
+
+            // a different netlist with the same hash, the newest one stays
+            removeEntry(it->second);
+        }
+        addEntry(key, netlist, circuit);
+    }
+
+    if (!directory.empty())
+        writeToDisk(key, netlist, *circuit);
+    return circuit;
+}
+
+size_t CircuitCache::getMemoryUsage() const
+{
+    lock_guard<mutex> guard(lock);
+    return memoryUsage;
+}
+
+// expects the lock to be held
+void CircuitCache::addEntry(const string &key, const string &netlist, circuitHandle circuit)
+{
+    entries.push_front({key, netlist, circuit});
+    index[key] = entries.begin();
+    memoryUsage += estimateSize(*circuit) + netlist.size();
+    evict();
+}
+
+// expects the lock to be held
+void CircuitCache::removeEntry(entryList::iterator entry)
+{
+    memoryUsage -= estimateSize(*entry->circuit) + entry->netlist.size();
+    index.erase(entry->key);
+    entries.erase(entry);
+}
+
+// drop least recently used circuits until the budget is met, always keeping
+// the most recent one even if it alone is over budget
+void CircuitCache::evict()
+{
+    while (memoryUsage > memoryBudget && entries.size() > 1)
+        removeEntry(prev(entries.end()));
+}
+
+// a cache file starts with the netlist it was solved from, as a line
+// "netlist <bytes>" followed by the contents, then the circuit itself
+circuitHandle CircuitCache::readFromDisk(const string &key, const string &netlist) const
+{
+    ifstream file(directory + "/" + key + ".circuit", ios::binary);
+    if (!file.is_open())
+        return nullptr;
+
+    string label;
+    size_t bytes;
+    if (!(file >> label >> bytes) || label != "netlist" || bytes != netlist.size() || file.get() != '\n')
+        return nullptr;
+    string saved(bytes, '\0');
+    if (!file.read(&saved[0], bytes) || saved != netlist)
+        return nullptr;
+
+    shared_ptr<Circuit> circuit = make_shared<Circuit>();
+    if (!circuit->read(file))
+        return nullptr;
+    return circuit;
+}
+
+// write to a temporary file first so readers never see a partial circuit
+void CircuitCache::writeToDisk(const string &key, const string &netlist, const Circuit &circuit) const
+{
+    string path = directory + "/" + key + ".circuit";
+    string temporaryPath = path + ".tmp";
+
+    ofstream file(temporaryPath, ios::binary);
+    if (!file.is_open())
+        return;
+    file << "netlist " << netlist.size() << "\n";
+    file.write(netlist.data(), netlist.size());
+    circuit.write(file);
+    file.close();
+
+    if (file.fail() || rename(temporaryPath.c_str(), path.c_str()) != 0)
+        remove(temporaryPath.c_str());
+}
@@ -0,0 +1,67 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "circuit.h"
+
+using namespace std;
+
+// Solved circuits are shared read-only between everyone who loaded them
+typedef shared_ptr<const Circuit> circuitHandle;
+
+// Cache of solved circuits keyed by a hash of the netlist contents, so the
+// same netlist loaded from different paths is only parsed and solved once.
+// Each entry keeps the netlist it was solved from, in memory and on disk, and
+// a lookup only hits if the contents match, so two netlists whose hashes
+// collide never share a circuit.
+//
+// Circuits are kept in memory up to a budget in bytes and the least recently
+// used ones are evicted first. When a directory is given, solved circuits are
+// also saved there and restored on a memory miss. Evicting a circuit only
+// drops the cache's reference; handles already given out stay valid.
+class CircuitCache
+{
+public:
+    CircuitCache(size_t memoryBudget, const string &directory = "");
+
+    // key identifying a netlist by its contents
+    static string hashNetlist(const string &contents);
+
+    // return the cached circuit for a netlist, or nullptr on a miss
+    circuitHandle find(const string &netlist);
+
+    // add a circuit freshly solved from a netlist and return the handle to
+    // use for it
+    circuitHandle insert(const string &netlist, circuitHandle circuit);
+
+    size_t getMemoryUsage() const;
+
+private:
+    struct Entry
+    {
+        string key;
+        string netlist;
+        circuitHandle circuit;
+    };
+    typedef list<Entry> entryList;
+
+    size_t memoryBudget;
+    size_t memoryUsage;
+    string directory;
+    entryList entries; // most recently used first
+    unordered_map<string, entryList::iterator> index;
+    mutable mutex lock;
+
+    void addEntry(const string &key, const string &netlist, circuitHandle circuit);
+    void removeEntry(entryList::iterator entry);
+    void evict();
+    circuitHandle readFromDisk(const string &key, const string &netlist) const;
+    void writeToDisk(const string &key, const string &netlist, const Circuit &circuit) const;
+};
+
+#endif
@@ -1,71 +1,525 @@
 #include "circuit.h"
 
+#include <algorithm>
+#include <charconv>
 #include <fstream>
+#include <limits>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "mapped.h"
+#include "port.h"
 
 using namespace std;
 
 // default constructor
-Circuit::Circuit() {}
+template <typename Scalar, typename Index>
+BasicCircuit<Scalar, Index>::BasicCircuit() {}
 
 // Circuit constructor
-Circuit::Circuit(string netList)
+template <typename Scalar, typename Index>
+BasicCircuit<Scalar, Index>::BasicCircuit(string netList)
 {
     ifstream netListFile(netList);
+    string contents((istreambuf_iterator<char>(netListFile)), istreambuf_iterator<char>());
+    SubcircuitLibrary library;
+    this->load(contents, library, true);
+}
+
+// Circuit constructor from a netlist stream, read whole and then parsed
+template <typename Scalar, typename Index>
+BasicCircuit<Scalar, Index>::BasicCircuit(istream &netList, pmr::memory_resource *memory, LoadProgress *progress,
+                                          const OutOfCoreOptions *outOfCore)
+    : BasicCircuit(string(istreambuf_iterator<char>(netList), istreambuf_iterator<char>()), memory, progress,
+                   outOfCore)
+{
+}
+
+// Circuit constructor from netlist contents, with the temporaries of the
+// parse (the netlist lines and subcircuit library, see arena.h) allocated
+// from the given memory resource (e.g. a LoadArena) and its
+// progress reported to, and cancellable through, progress if given. With
+// outOfCore given, a matrix over its budget is solved in a scratch file
+template <typename Scalar, typename Index>
+BasicCircuit<Scalar, Index>::BasicCircuit(string_view netList, pmr::memory_resource *memory, LoadProgress *progress,
+                                          const OutOfCoreOptions *outOfCore)
+{
+    SubcircuitLibrary library(memory);
+    library.progress = progress;
+    library.outOfCore = outOfCore;
+    this->load(netList, library, true);
+}
+
+// edited netlist solved with the factorization of previous where possible
+template <typename Scalar, typename Index>
+BasicCircuit<Scalar, Index>::BasicCircuit(const BasicCircuit &previous, string_view netList, pmr::memory_resource *memory,
+                                          LoadProgress *progress, const OutOfCoreOptions *outOfCore)
+{
+    SubcircuitLibrary library(memory);
+    library.progress = progress;
+    library.outOfCore = outOfCore;
+    this->parse(netList, library, progress != nullptr);
 
-    string component;
-    while (getline(netListFile, component))
+    if (progress != nullptr)
     {
-        istringstream in(component);
-        if (component[0] == 'V')
-            this->addBattery(in);
-        else if (component[0] == 'R')
-            this->addResistor(in);
+        progress->phase = LoadProgress::ASSEMBLING;
+        progress->percent = 0;
+    }
+    countNodes();
+    if (needsOutOfCore(outOfCore) || !reuseFactorization(previous, progress))
+        makeConductanceMatrices(progress, outOfCore);
+
+    if (progress != nullptr)
+    {
+        progress->phase = LoadProgress::DONE;
+        progress->percent = 100;
     }
+}
+
+// subcircuit body, assembled but not solved so it can be reduced to its ports
+template <typename Scalar, typename Index>
+BasicCircuit<Scalar, Index>::BasicCircuit(string_view netList, SubcircuitLibrary &library)
+{
+    this->load(netList, library, false);
+}
+
+// parse the netlist and solve the circuit
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::load(string_view netList, SubcircuitLibrary &library, bool solve)
+{
+    // subcircuit bodies are part of the parsing phase of the top-level load
+    LoadProgress *progress = library.progress;
+    bool reporting = solve && progress != nullptr;
+    this->parse(netList, library, reporting);
 
-    constructBranchIncidenceMatrix();
-    makeConductanceMatrices();
+    if (reporting)
+    {
+        progress->phase = LoadProgress::ASSEMBLING;
+        progress->percent = 0;
+    }
+    countNodes();
+    if (!solve)
+    {
+        assembleSourceVector();
+        return;
+    }
+    makeConductanceMatrices(progress, library.outOfCore);
 
     // printNodeVoltages();
     // printSourceCurrents();
     // printBatteries();
 
-    for(unsigned int i = 0; i < this->sourceCurrents.size(); i++)
+    if (reporting)
+    {
+        progress->phase = LoadProgress::DONE;
+        progress->percent = 100;
+    }
+}
+
+// read the components of a netlist, reducing the subcircuits it instantiates.
+// Lines and subcircuit bodies are views into netList, which is not copied
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::parse(string_view netList, SubcircuitLibrary &library, bool reporting)
+{
+    size_t next = 0;
+    auto getLine = [&](string_view &line) {
+        if (next >= netList.size())
+            return false;
+        size_t end = min(netList.find('\n', next), netList.size());
+        line = netList.substr(next, end - next);
+        next = end + 1;
+        return true;
+    };
+
+    // collect subcircuit definitions first so instances may come before them
+    pmr::vector<string_view> components(library.memory);
+    string_view component;
+    while (getLine(component))
+    {
+        if (component.compare(0, 7, ".subckt") != 0)
+        {
+            if (!component.empty())
+                components.push_back(component);
+            continue;
+        }
+
+        // the header is split in place: the name, then the port nodes
+        string_view header = component.substr(7);
+        auto getToken = [&header](string_view &token) {
+            size_t start = header.find_first_not_of(" \t\r");
+            if (start == string_view::npos)
+                return false;
+            size_t end = min(header.find_first_of(" \t\r", start), header.size());
+            token = header.substr(start, end - start);
+            header.remove_prefix(end);
+            return true;
+        };
+        string_view name, token;
+        pmr::vector<Index> ports(library.memory);
+        getToken(name);
+        while (getToken(token))
+        {
+            Index port;
+            if (from_chars(token.data(), token.data() + token.size(), port).ptr != token.data() + token.size())
+                break;
+            ports.push_back(port);
+        }
+
+        // the body runs from the line after the header to the .ends line
+        size_t bodyStart = min(next, netList.size());
+        size_t bodyEnd = bodyStart;
+        string_view line;
+        while (getLine(line) && line.compare(0, 5, ".ends") != 0)
+            bodyEnd = min(next, netList.size());
+        library.definitions[name] = {move(ports), netList.substr(bodyStart, bodyEnd - bodyStart)};
+    }
+
+    LoadProgress *progress = library.progress;
+    if (reporting)
+    {
+        progress->phase = LoadProgress::PARSING;
+        progress->percent = 0;
+    }
+
+    // one stream and line buffer are reused for every component
+    istringstream in;
+    string line;
+    size_t parsed = 0;
+    for (string_view component : components)
+    {
+        if (progress != nullptr && progress->cancelled)
+            throw LoadCancelled();
+        if (reporting)
+            progress->percent = 100 * parsed++ / components.size();
+
+        line.assign(component.begin(), component.end());
+        in.str(line);
+        in.clear();
+        if (component[0] == 'V')
+            this->addBattery(in);
+        else if (component[0] == 'R')
+            this->addResistor(in);
+        else if (component[0] == 'C')
+            this->addCapacitor(in);
+        else if (component[0] == 'L')
+            this->addInductor(in);
+        else if (component[0] == 'X')
+            this->addSubcircuit(in, library);
+    }
+}
+
+// name the solved currents for lookup
+template <typename Scalar, typename Index>
+map<string, Scalar> BasicCircuit<Scalar, Index>::buildCurrents() const
+{
+    map<string, Scalar> currents;
+    for(size_t i = 0; i < this->sourceCurrents.size(); i++)
         currents.insert({"V" + to_string(i + 1), sourceCurrents[i]});
 
-    for(unsigned int i = 0; i < resistorCurrents.size(); i++) 
+    const vector<Scalar> &resistorCurrents = getResistorCurrents();
+    for(size_t i = 0; i < resistorCurrents.size(); i++) 
         currents.insert({"R" + to_string(i + 1), resistorCurrents[i]});
 
-    for(unsigned int i = 0; i < this->nodeVoltages.size(); i++)
+    // no DC current flows through a capacitor
+    for(size_t i = 0; i < capacitors.size(); i++)
+        currents.insert({"C" + to_string(i + 1), Scalar(0)});
+
+    for(size_t i = 0; i < inductorCurrents.size(); i++)
+        currents.insert({"L" + to_string(i + 1), inductorCurrents[i]});
+    return currents;
+}
+
+// name the solved voltages for lookup
+template <typename Scalar, typename Index>
+map<string, Scalar> BasicCircuit<Scalar, Index>::buildVoltages() const
+{
+    map<string, Scalar> voltages;
+    for(size_t i = 0; i < this->nodeVoltages.size(); i++)
         voltages.insert({"V" + to_string(i), nodeVoltages[i]});
+    return voltages;
+}
+
+template <typename Scalar, typename Index>
+const vector<Scalar> &BasicCircuit<Scalar, Index>::getResistorCurrents() const
+{
+    return resistorCurrents.get([this]() {
+        vector<Scalar> currents(this->resistors.size());
+        for (size_t i = 0; i < currents.size(); i++)
+            currents[i] = getResistorCurrent(i);
+        return currents;
+    });
+}
+
+template <typename Scalar, typename Index>
+const map<string, Scalar> &BasicCircuit<Scalar, Index>::getCurrents() const
+{
+    return currents.get([this]() { return buildCurrents(); });
+}
+
+template <typename Scalar, typename Index>
+const map<string, Scalar> &BasicCircuit<Scalar, Index>::getVoltages() const
+{
+    return voltages.get([this]() { return buildVoltages(); });
+}
+
+template <typename Scalar, typename Index>
+const vector<vector<Scalar>> &BasicCircuit<Scalar, Index>::getBranchIncidenceMatrix() const
+{
+    return branchIncidenceMatrix.get([this]() { return constructBranchIncidenceMatrix(); });
+}
+
+template <typename Scalar, typename Index>
+vector<Scalar> BasicCircuit<Scalar, Index>::getNodeVoltages(const vector<Index> &nodes) const
+{
+    vector<Scalar> values;
+    values.reserve(nodes.size());
+    for (Index node : nodes)
+        values.push_back(nodeVoltages.at(node));
+    return values;
+}
+
+template <typename Scalar, typename Index>
+Scalar BasicCircuit<Scalar, Index>::getResistorCurrent(size_t resistor) const
+{
+    const tuple<Index, Index, Scalar> &component = resistors.at(resistor);
+    return (nodeVoltages[get<0>(component)] - nodeVoltages[get<1>(component)]) / get<2>(component);
+}
+
+template <typename Scalar, typename Index>
+vector<Scalar> BasicCircuit<Scalar, Index>::getResistorCurrents(const vector<size_t> &resistors) const
+{
+    vector<Scalar> values;
+    values.reserve(resistors.size());
+    for (size_t resistor : resistors)
+        values.push_back(getResistorCurrent(resistor));
+    return values;
+}
+
+// current through a component named like the keys of getCurrents(), e.g. R2
+template <typename Scalar, typename Index>
+bool BasicCircuit<Scalar, Index>::getCurrent(const string &name, Scalar &current) const
+{
+    if (name.size() < 2 || name.find_first_not_of("0123456789", 1) != string::npos || name[1] == '0')
+        return false;
+    size_t number = stoull(name.substr(1));
+
+    switch (name[0])
+    {
+    case 'V':
+        if (number > sourceCurrents.size())
+            return false;
+        current = sourceCurrents[number - 1];
+        return true;
+    case 'R':
+        if (number > resistors.size())
+            return false;
+        current = getResistorCurrent(number - 1);
+        return true;
+    case 'C':
+        if (number > capacitors.size())
+            return false;
+        current = Scalar(0);
+        return true;
+    case 'L':
+        if (number > inductorCurrents.size())
+            return false;
+        current = inductorCurrents[number - 1];
+        return true;
+    }
+    return false;
+}
+
+template <typename Scalar, typename Index>
+static void writeComponents(ostream &out, const string &label, const vector<tuple<Index, Index, Scalar>> &components)
+{
+    out << label << " " << components.size() << "\n";
+    for (const tuple<Index, Index, Scalar> &tuple : components)
+        out << get<0>(tuple) << " " << get<1>(tuple) << " " << get<2>(tuple) << "\n";
+}
+
+template <typename Scalar>
+static void writeValues(ostream &out, const string &label, const vector<Scalar> &values)
+{
+    out << label << " " << values.size() << "\n";
+    for (Scalar value : values)
+        out << value << "\n";
+}
+
+// each distinct subcircuit model once, then the instances by name
+template <typename Scalar, typename Index>
+static void writeSubcircuits(ostream &out, const vector<typename BasicCircuit<Scalar, Index>::SubcircuitInstance> &subcircuits)
+{
+    typedef typename BasicCircuit<Scalar, Index>::SubcircuitInstance SubcircuitInstance;
+    map<string, shared_ptr<const BasicPortModel<Scalar, Index>>> models;
+    for (const SubcircuitInstance &instance : subcircuits)
+        models[instance.name] = instance.model;
+
+    out << "subcircuits " << models.size() << "\n";
+    for (const auto &model : models)
+    {
+        out << model.first << "\n";
+        model.second->write(out);
+    }
+
+    out << "instances " << subcircuits.size() << "\n";
+    for (const SubcircuitInstance &instance : subcircuits)
+    {
+        out << instance.name << " " << instance.nodes.size();
+        for (Index node : instance.nodes)
+            out << " " << node;
+        out << "\n";
+    }
+}
+
+template <typename Scalar, typename Index>
+static bool readSubcircuits(istream &in, vector<typename BasicCircuit<Scalar, Index>::SubcircuitInstance> &subcircuits)
+{
+    typedef typename BasicCircuit<Scalar, Index>::SubcircuitInstance SubcircuitInstance;
+    typedef BasicPortModel<Scalar, Index> PortModel;
+    string label;
+    size_t count;
+    map<string, shared_ptr<const PortModel>> models;
+    if (!(in >> label >> count) || label != "subcircuits")
+        return false;
+    for (size_t i = 0; i < count; i++)
+    {
+        string name;
+        shared_ptr<PortModel> model = make_shared<PortModel>();
+        if (!(in >> name) || !model->read(in))
+            return false;
+        models[name] = model;
+    }
+
+    if (!(in >> label >> count) || label != "instances")
+        return false;
+    subcircuits.resize(count);
+    for (SubcircuitInstance &instance : subcircuits)
+    {
+        size_t numNodes;
+        if (!(in >> instance.name >> numNodes) || !models.count(instance.name))
+            return false;
+        instance.model = models[instance.name];
+        instance.nodes.resize(numNodes);
+        for (Index &node : instance.nodes)
+        {
+            if (!(in >> node))
+                return false;
+        }
+        if (instance.model->ports.size() != numNodes)
+            return false;
+    }
+    return true;
+}
+
+template <typename Scalar, typename Index>
+static bool readComponents(istream &in, const string &label, vector<tuple<Index, Index, Scalar>> &components)
+{
+    string name;
+    size_t count;
+    if (!(in >> name >> count) || name != label)
+        return false;
+
+    components.resize(count);
+    for (tuple<Index, Index, Scalar> &tuple : components)
+    {
+        if (!(in >> get<0>(tuple) >> get<1>(tuple)) || !readScalar(in, get<2>(tuple)))
+            return false;
+    }
+    return true;
+}
+
+template <typename Scalar>
+static bool readValues(istream &in, const string &label, vector<Scalar> &values)
+{
+    string name;
+    size_t count;
+    if (!(in >> name >> count) || name != label)
+        return false;
+
+    values.resize(count);
+    for (Scalar &value : values)
+    {
+        if (!readScalar(in, value))
+            return false;
+    }
+    return true;
+}
+
+// save the components and solution so the circuit can be restored without solving
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::write(ostream &out) const
+{
+    out << setprecision(numeric_limits<typename RealType<Scalar>::type>::max_digits10);
+    out << "circuit-analysis 5\n";
+    out << "outOfCore " << outOfCore << "\n";
+    writeComponents(out, "batteries", batteries);
+    writeComponents(out, "resistors", resistors);
+    writeComponents(out, "capacitors", capacitors);
+    writeComponents(out, "inductors", inductors);
+    writeSubcircuits<Scalar, Index>(out, subcircuits);
+    writeValues(out, "nodeVoltages", nodeVoltages);
+    writeValues(out, "sourceCurrents", sourceCurrents);
+    writeValues(out, "inductorCurrents", inductorCurrents);
+}
+
+// restore a circuit saved with write(), returns false if the data is malformed
+template <typename Scalar, typename Index>
+bool BasicCircuit<Scalar, Index>::read(istream &in)
+{
+    string magic;
+    int version;
+    string label;
+    if (!(in >> magic >> version) || magic != "circuit-analysis" || version != 5)
+        return false;
+    if (!(in >> label >> outOfCore) || label != "outOfCore")
+        return false;
+
+    if (!readComponents(in, "batteries", batteries) ||
+        !readComponents(in, "resistors", resistors) ||
+        !readComponents(in, "capacitors", capacitors) ||
+        !readComponents(in, "inductors", inductors) ||
+        !readSubcircuits<Scalar, Index>(in, subcircuits) ||
+        !readValues(in, "nodeVoltages", nodeVoltages) ||
+        !readValues(in, "sourceCurrents", sourceCurrents) ||
+        !readValues(in, "inductorCurrents", inductorCurrents))
+        return false;
+
+    countNodes();
+    if (!outOfCore)
+        assembleSourceVector();
+    return true;
 }
 
 // utlitiy for print debugging
-void Circuit::printNodeVoltages()
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::printNodeVoltages()
 {
     // print node voltages
     cout << "Voltage values at nodes: " << endl;
-    for(unsigned int i = 0; i < this->nodeVoltages.size(); i++) {
+    for(size_t i = 0; i < this->nodeVoltages.size(); i++) {
         cout << setw(12) << nodeVoltages[i] << endl;
     }
     cout << endl;
 }
 
 // utlitiy for print debugging
-void Circuit::printSourceCurrents()
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::printSourceCurrents()
 {
     cout << "\n\nCurrent values through sources: " << endl;
-    for(unsigned int i = 0; i < this->sourceCurrents.size(); i++) {
+    for(size_t i = 0; i < this->sourceCurrents.size(); i++) {
         cout << setw(12) << sourceCurrents[i] << endl;
     }
     cout << endl;
 }
 
 // utlitiy for print debugging
-void Circuit::printBatteries()
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::printBatteries()
 {
     cout << "Voltage Sources (source | destination | voltage):" << endl;
-    for (tuple<int, int, double> &tuple : this->batteries)
+    for (tuple<Index, Index, Scalar> &tuple : this->batteries)
     {
         cout << setw(3)
              << get<0>(tuple) << setw(3)
@@ -77,10 +531,11 @@ void Circuit::printBatteries()
 }
 
 // utlitiy for print debugging
-void Circuit::printResistors()
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::printResistors()
 {
     cout << "Resistors (source | destination | resistance):" << endl;
-    for (tuple<int, int, double> &tuple : this->resistors)
+    for (tuple<Index, Index, Scalar> &tuple : this->resistors)
     {
         cout << setw(3)
              << get<0>(tuple) << setw(3)
@@ -92,13 +547,14 @@ void Circuit::printResistors()
 }
 
 // check if two nodes are connected
-bool Circuit::checkNodeListValidity(vector<pair<int, int>> nodePairs){
+template <typename Scalar, typename Index>
+bool BasicCircuit<Scalar, Index>::checkNodeListValidity(const vector<pair<Index, Index>> &nodePairs){
     if (nodePairs.empty()) {
         return false;
     }
 
-    int node1 = nodePairs.front().first;
-    int node2 = nodePairs.back().second;
+    Index node1 = nodePairs.front().first;
+    Index node2 = nodePairs.back().second;
 
     for (const auto& pair : nodePairs) {
         if ((pair.first == node1 && pair.second == node2) ||
@@ -110,12 +566,13 @@ bool Circuit::checkNodeListValidity(vector<pair<int, int>> nodePairs){
 }
 
 // utlitiy for print debugging
-void Circuit::printBranchIncidenceMatrix()
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::printBranchIncidenceMatrix()
 {
     cout << "Branch Incidence Matrix:" << endl;
-    for (vector<double> row : this->branchIncidenceMatrix)
+    for (const vector<Scalar> &row : getBranchIncidenceMatrix())
     {
-        for (int element : row)
+        for (Scalar element : row)
         {
             cout << setw(3) << element;
             
@@ -126,59 +583,71 @@ void Circuit::printBranchIncidenceMatrix()
     cout << endl;
 }
 
-void Circuit::constructBranchIncidenceMatrix()
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::countNodes()
 {
-    // Get number of branches
-    int numBranches = this->batteries.size() + this->resistors.size();
+    const tupleVector *branches[] = {&this->batteries, &this->resistors, &this->capacitors, &this->inductors};
 
     // Get number of nodes
-    int numNodes = 0;
-    for (const tuple<int, int, double> &tuple : this->batteries)
+    numNodes = 0;
+    for (const tupleVector *components : branches)
     {
-        if (get<0>(tuple) > numNodes)
-            numNodes = get<0>(tuple);
-        if (get<1>(tuple) > numNodes)
-            numNodes = get<1>(tuple);
+        for (const tuple<Index, Index, Scalar> &tuple : *components)
+        {
+            if (get<0>(tuple) > numNodes)
+                numNodes = get<0>(tuple);
+            if (get<1>(tuple) > numNodes)
+                numNodes = get<1>(tuple);
+        }
     }
-
-    for (const tuple<int, int, double> &tuple : this->resistors)
+    for (const SubcircuitInstance &instance : this->subcircuits)
     {
-        if (get<0>(tuple) > numNodes)
-            numNodes = get<0>(tuple);
-        if (get<1>(tuple) > numNodes)
-            numNodes = get<1>(tuple);
+        for (Index node : instance.nodes)
+        {
+            if (node > numNodes)
+                numNodes = node;
+        }
     }
     numNodes += 1;
+}
+
+template <typename Scalar, typename Index>
+vector<vector<Scalar>> BasicCircuit<Scalar, Index>::constructBranchIncidenceMatrix() const
+{
+    const tupleVector *branches[] = {&this->batteries, &this->resistors, &this->capacitors, &this->inductors};
+
+    // Get number of branches
+    size_t numBranches = 0;
+    for (const tupleVector *components : branches)
+        numBranches += components->size();
 
     // Initialize branch incidence matrix
-    this->branchIncidenceMatrix.resize(numNodes, vector<double>(numBranches, 0));
+    vector<vector<Scalar>> branchIncidenceMatrix(numNodes, vector<Scalar>(numBranches, Scalar(0)));
 
     // Populate branch incidence matrix
-    int branchIndex = 0;
-    for (tuple<int, int, double> tuple : this->batteries)
+    size_t branchIndex = 0;
+    for (const tupleVector *components : branches)
     {
-        branchIncidenceMatrix[get<0>(tuple)][branchIndex] = 1.0;
-        branchIncidenceMatrix[get<1>(tuple)][branchIndex] = -1.0;
-        branchIndex++;
-    }
-
-    for (tuple<int, int, double> tuple : this->resistors)
-    {
-        branchIncidenceMatrix[get<0>(tuple)][branchIndex] = 1;
-        branchIncidenceMatrix[get<1>(tuple)][branchIndex] = -1;
-        branchIndex++;
+        for (const tuple<Index, Index, Scalar> &tuple : *components)
+        {
+            branchIncidenceMatrix[get<0>(tuple)][branchIndex] = Scalar(1);
+            branchIncidenceMatrix[get<1>(tuple)][branchIndex] = Scalar(-1);
+            branchIndex++;
+        }
     }
     // Remove the first row from the matrix to get reduced matrix
-    // if (!this->branchIncidenceMatrix.empty()) {
-    //     this->branchIncidenceMatrix.erase(this->branchIncidenceMatrix.begin());
+    // if (!branchIncidenceMatrix.empty()) {
+    //     branchIncidenceMatrix.erase(branchIncidenceMatrix.begin());
     // }
+    return branchIncidenceMatrix;
 }
 
-void printMatrix(vector<vector<double>> matrix)
+template <typename Scalar>
+void printMatrix(const vector<vector<Scalar>> &matrix)
 {
-    for (vector<double> row : matrix)
+    for (const vector<Scalar> &row : matrix)
     {
-        for (double element : row)
+        for (Scalar element : row)
         {
             cout << setw(12) << element;
         }
@@ -187,212 +656,587 @@ void printMatrix(vector<vector<double>> matrix)
     cout << endl;
 }
 
-void Circuit::makeConductanceMatrices()
+// components (or matrix entries) below which a thread is not worth starting
+static const size_t minAssemblyWork = 1 << 15;
+
+// threads to share work of the given size between, up to one per core
+static unsigned int getAssemblyThreads(size_t work)
 {
-    int numNodes = branchIncidenceMatrix.size() + batteries.size(); // Include supernodes
-    vector<vector<double>> G(numNodes, vector<double>(numNodes, 0.0));
+    size_t numThreads = min<size_t>(max(1u, thread::hardware_concurrency()), work / minAssemblyWork);
+    return max<size_t>(numThreads, 1);
+}
 
-    // Construct the conductance matrix for resistors
-    for (auto &resistor : resistors)
-    {
-        int i = get<0>(resistor);
-        int j = get<1>(resistor);
-        double R = get<2>(resistor);
-        double conductance = 1.0 / R;
+// run work(part) for every part, each on its own thread
+template <typename Work>
+static void runParts(unsigned int numParts, Work work)
+{
+    vector<thread> workers;
+    for (unsigned int part = 1; part < numParts; part++)
+        workers.emplace_back(work, part);
+    work(0);
+    for (thread &worker : workers)
+        worker.join();
+}
 
-        G[i][i] += conductance;
-        G[j][j] += conductance;
-        G[i][j] -= conductance;
-        G[j][i] -= conductance;
-    }
+template <typename Scalar, typename Index>
+size_t BasicCircuit<Scalar, Index>::getSystemSize() const
+{
+    return numNodes - 1 + batteries.size() + inductors.size(); // Include supernodes
+}
 
-    // Initialize current source vector
-    vector<double> Is(numNodes, 0.0);
+// Build the MNA matrix with the reference node removed, skipping stamps on
+// the reference node. The load factors it in place, so it is assembled again
+// from the components whenever an analysis needs it
+template <typename Scalar, typename Index>
+vector<vector<Scalar>> BasicCircuit<Scalar, Index>::getConductanceMatrix() const
+{
+    if (outOfCore)
+        throw logic_error("the conductance matrix was factored out of core and not kept");
+    size_t size = getSystemSize();
+
+    // rows are allocated and cleared by several threads for large systems
+    vector<vector<Scalar>> G(size);
+    unsigned int numThreads = getAssemblyThreads(size * size);
+    runParts(numThreads, [&G, size, numThreads](unsigned int part) {
+        for (size_t i = size * part / numThreads; i < size * (part + 1) / numThreads; i++)
+            G[i].assign(size, Scalar(0));
+    });
+    stampConductanceMatrix(G);
+    return G;
+}
 
-    // Construct conductance matrix for voltage sources and update current source vector
-    int supernode = branchIncidenceMatrix.size(); // Initial supernode index
-    for (auto &battery : batteries)
-    {
-        int i = get<0>(battery);    // Source node
-        int j = get<1>(battery);    // Destination node
-        double V = get<2>(battery); // Voltage value
+// the right-hand side: voltage source values and subcircuit Norton currents
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::assembleSourceVector()
+{
+    vector<Scalar> &Is = this->sourceVector;
+    Is.assign(getSystemSize(), Scalar(0));
 
-        G[i][supernode] = 1;
-        G[supernode][i] = 1;
-        G[j][supernode] = -1;
-        G[supernode][j] = -1;
+    for (const SubcircuitInstance &instance : subcircuits)
+    {
+        for (size_t a = 0; a < instance.nodes.size(); a++)
+        {
+            if (instance.nodes[a] != 0)
+                Is[instance.nodes[a] - 1] += instance.model->nortonCurrents[a];
+        }
+    }
 
-        Is[supernode] = V;
+    size_t supernode = numNodes - 1;
+    for (auto &battery : batteries)
+        Is[supernode++] = get<2>(battery);
+}
 
-        supernode++; // Increment supernode index for next voltage source
+// add every component's stamp to a zeroed matrix, with G[i][j] addressing
+// either the in-memory matrix or a mapped one
+template <typename Scalar, typename Index>
+template <typename Matrix>
+void BasicCircuit<Scalar, Index>::stampConductanceMatrix(Matrix &G) const
+{
+    // Construct the conductance matrix for resistors
+    unsigned int numThreads = getAssemblyThreads(resistors.size());
+    if (numThreads == 1)
+    {
+        for (auto &resistor : resistors)
+        {
+            Index i = get<0>(resistor);
+            Index j = get<1>(resistor);
+            Scalar R = get<2>(resistor);
+            Scalar conductance = Scalar(1) / R;
+
+            if (i != 0)
+                G[i - 1][i - 1] += conductance;
+            if (j != 0)
+                G[j - 1][j - 1] += conductance;
+            if (i != 0 && j != 0)
+            {
+                G[i - 1][j - 1] -= conductance;
+                G[j - 1][i - 1] -= conductance;
+            }
+        }
     }
+    else
+        stampResistorsInParallel(G, numThreads);
 
-    // Remove first column and first row (corresponding to the reference node)
-    G.erase(G.begin());
-    for (vector<double> &row : G)
+    // Every subcircuit instance adds its port conductances
+    for (const SubcircuitInstance &instance : subcircuits)
     {
-        row.erase(row.begin());
+        const PortModel &model = *instance.model;
+        for (size_t a = 0; a < instance.nodes.size(); a++)
+        {
+            if (instance.nodes[a] == 0)
+                continue;
+            for (size_t b = 0; b < instance.nodes.size(); b++)
+            {
+                if (instance.nodes[b] != 0)
+                    G[instance.nodes[a] - 1][instance.nodes[b] - 1] += model.admittance[a][b];
+            }
+        }
     }
-    Is.erase(Is.begin());
 
-    G = getMatrixWithNewColumn(&G, Is);
+    // Construct conductance matrix for voltage sources
+    size_t supernode = numNodes - 1; // Initial supernode row
+    for (auto &battery : batteries)
+    {
+        Index i = get<0>(battery); // Source node
+        Index j = get<1>(battery); // Destination node
 
-    // printMatrix(G);
+        if (i != 0)
+        {
+            G[i - 1][supernode] = 1;
+            G[supernode][i - 1] = 1;
+        }
+        if (j != 0)
+        {
+            G[j - 1][supernode] = -1;
+            G[supernode][j - 1] = -1;
+        }
 
-    // Solve
-    vector<double> V = this->solveMatrix(&G, 0);
+        supernode++; // Increment supernode index for next voltage source
+    }
 
-    // Add 0 to the beginning of the solution vector
-    V.insert(V.begin(), 0);
+    for (Index node : getFloatingNodes())
+        G[node - 1][node - 1] += Scalar(1);
 
-    // Print solution
-    // for (double element : V)
-    // {
-    //     cout << setw(12) << element;
-    // }
+    // At DC an inductor is a short, a voltage source of 0 V whose current is
+    // solved for. Capacitors are open and leave no stamp
+    for (auto &inductor : inductors)
+    {
+        Index i = get<0>(inductor);
+        Index j = get<1>(inductor);
 
-    // Add to node voltages all values - the number of voltage sources
-    // this->nodeVoltages.resize(V.size()-batteries.size());
-    for (long long unsigned int i = 0; i < V.size()-batteries.size(); i++)
+        if (i != 0)
+        {
+            G[i - 1][supernode] += 1;
+            G[supernode][i - 1] += 1;
+        }
+        if (j != 0)
+        {
+            G[j - 1][supernode] -= 1;
+            G[supernode][j - 1] -= 1;
+        }
+
+        supernode++;
+    }
+}
+
+template <typename Scalar, typename Index>
+vector<Index> BasicCircuit<Scalar, Index>::getDcGroups() const
+{
+    vector<Index> group(numNodes);
+    for (Index node = 0; node < numNodes; node++)
+        group[node] = node;
+    auto find = [&](Index node) {
+        while (group[node] != node)
+            node = group[node] = group[group[node]];
+        return node;
+    };
+    auto join = [&](Index a, Index b) { group[find(a)] = find(b); };
+
+    for (const tupleVector *branches : {&resistors, &batteries, &inductors})
     {
-        this->nodeVoltages.push_back(V[i]);
+        for (const tuple<Index, Index, Scalar> &branch : *branches)
+            join(get<0>(branch), get<1>(branch));
     }
 
-    // Add to source currents all values - the number of voltage sources
-    for (long long unsigned int i = V.size()-batteries.size(); i < V.size(); i++)
+    // subcircuit ports are taken to have a DC path to ground
+    for (const SubcircuitInstance &instance : subcircuits)
     {
-        this->sourceCurrents.push_back(V[i]);
+        for (Index node : instance.nodes)
+            join(node, 0);
     }
 
-    resistorCurrents = this->getResistorCurrents();
+    for (Index node = 0; node < numNodes; node++)
+        group[node] = find(node);
+    return group;
 }
 
-
-void transpose(vector<vector<int>> matrix)
+template <typename Scalar, typename Index>
+vector<Index> BasicCircuit<Scalar, Index>::getFloatingNodes() const
 {
-    for (long long unsigned int i = 0; i < matrix.size(); i++)
+    vector<Index> group = getDcGroups();
+    vector<bool> tied(numNodes, false);
+    vector<Index> floating;
+    for (const tuple<Index, Index, Scalar> &capacitor : capacitors)
     {
-        for (long long unsigned int j = 0; j < matrix[0].size(); j++)
+        for (Index node : {get<0>(capacitor), get<1>(capacitor)})
         {
-            int temp = matrix[i][j];
-            matrix[i][j] = matrix[j][i];
-            matrix[j][i] = temp;
+            Index root = group[node];
+            if (root != group[0] && !tied[root])
+            {
+                tied[root] = true;
+                floating.push_back(node);
+            }
         }
     }
+    sort(floating.begin(), floating.end());
+    return floating;
 }
 
-void multiply(vector<vector<int>> matrix, vector<vector<int>> matrix2)
+// Each thread turns a contiguous slice of the resistors into stamps, sorted
+// into one list per block of rows. Each block is then owned by one thread,
+// which adds the lists of every slice in resistor order. Every entry thus
+// receives the same additions in the same order as in the serial loop, so
+// the matrix is bit-identical whatever the number of threads.
+template <typename Scalar, typename Index>
+template <typename Matrix>
+void BasicCircuit<Scalar, Index>::stampResistorsInParallel(Matrix &G, unsigned int numThreads) const
 {
-    vector<vector<int>> result;
-    result.resize(matrix.size(), vector<int>(matrix2[0].size(), 0));
-
-    for (long long unsigned int i = 0; i < matrix.size(); i++)
+    struct Stamp
     {
-        for (long long unsigned int j = 0; j < matrix2[0].size(); j++)
+        Index row, column;
+        Scalar value;
+    };
+
+    size_t size = getSystemSize();
+    size_t rowsPerBlock = (size + numThreads - 1) / numThreads;
+    vector<vector<vector<Stamp>>> stamps(numThreads, vector<vector<Stamp>>(numThreads));
+
+    runParts(numThreads, [&](unsigned int slice) {
+        vector<vector<Stamp>> &blocks = stamps[slice];
+        auto add = [&blocks, rowsPerBlock](Index row, Index column, Scalar value) {
+            blocks[row / rowsPerBlock].push_back({row, column, value});
+        };
+
+        size_t first = resistors.size() * slice / numThreads;
+        size_t last = resistors.size() * (slice + 1) / numThreads;
+        for (size_t k = first; k < last; k++)
         {
-            for (long long unsigned int k = 0; k < matrix[0].size(); k++)
+            Index i = get<0>(resistors[k]);
+            Index j = get<1>(resistors[k]);
+            Scalar conductance = Scalar(1) / get<2>(resistors[k]);
+
+            if (i != 0)
+                add(i - 1, i - 1, conductance);
+            if (j != 0)
+                add(j - 1, j - 1, conductance);
+            if (i != 0 && j != 0)
             {
-                result[i][j] += matrix[i][k] * matrix2[k][j];
+                add(i - 1, j - 1, -conductance);
+                add(j - 1, i - 1, -conductance);
             }
         }
+    });
+
+    runParts(numThreads, [&](unsigned int block) {
+        for (unsigned int slice = 0; slice < numThreads; slice++)
+        {
+            for (const Stamp &stamp : stamps[slice][block])
+                G[stamp.row][stamp.column] += stamp.value;
+            vector<Stamp>().swap(stamps[slice][block]);
+        }
+    });
+}
+
+// a dense matrix of this circuit's size would not fit the out-of-core budget
+template <typename Scalar, typename Index>
+bool BasicCircuit<Scalar, Index>::needsOutOfCore(const OutOfCoreOptions *options) const
+{
+    size_t size = getSystemSize();
+    return options != nullptr && size * size * sizeof(Scalar) > options->memoryBudget;
+}
+
+// assemble and factor in a scratch file a panel at a time, keeping only the
+// solution in memory. Throws runtime_error if the matrix is singular
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::solveOutOfCore(const OutOfCoreOptions &options, LoadProgress *progress)
+{
+    size_t size = getSystemSize();
+    BasicMappedLUFactorization<Scalar> factors(options.directory, size, options.memoryBudget);
+    assembleSourceVector();
+    stampConductanceMatrix(factors);
+
+    if (progress != nullptr)
+    {
+        progress->phase = LoadProgress::SOLVING;
+        progress->percent = 0;
     }
+    size_t panels = factors.getPanelCount();
+    for (size_t panel = 0; panel < panels; panel++)
+    {
+        if (progress != nullptr && progress->cancelled)
+            throw LoadCancelled();
+        if (progress != nullptr)
+            progress->percent = 100 * panel / panels;
+        factors.factorPanel(panel);
+    }
+    if (factors.singular)
+        throw runtime_error("the conductance matrix is singular");
+
+    outOfCore = true;
+    setSolution(factors.solve(sourceVector));
 }
 
-void ensureZerosAtBottom(vector<vector<double>> *matrix_ptr, int depth)
+// each refinement step solves G d = b - G x with the same factors and adds d
+// to x, recovering accuracy the first solve lost to rounding. G is assembled
+// again for the residuals and dropped afterwards
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::refineSolution(int iterations)
 {
-    for (long long unsigned int i = depth; i < matrix_ptr->size(); i++)
+    const BasicLUFactorization<Scalar> &factors = getFactorization();
+    const vector<vector<Scalar>> G = getConductanceMatrix();
+    vector<Scalar> x = factors.solve(sourceVector);
+    for (int iteration = 0; iteration < iterations; iteration++)
     {
-        if ((*matrix_ptr)[i][depth] == 0)
+        vector<Scalar> r(sourceVector);
+        for (size_t i = 0; i < G.size(); i++)
         {
-            for (long long unsigned int j = i + 1; j < matrix_ptr->size(); j++)
-            {
-                if ((*matrix_ptr)[j][depth] != 0)
-                {
-                    swap((*matrix_ptr)[i], (*matrix_ptr)[j]);
-                    break;
-                }
-            }
+            for (size_t j = 0; j < G.size(); j++)
+                r[i] -= G[i][j] * x[j];
         }
+        vector<Scalar> d = factors.solve(r);
+        for (size_t i = 0; i < x.size(); i++)
+            x[i] += d[i];
     }
+
+    setSolution(x);
+    solveMethod = REFINED_SOLVE;
+
+    // anything derived from the previous solution is computed again
+    resistorCurrents = Lazy<vector<Scalar>>();
+    currents = Lazy<map<string, Scalar>>();
+    voltages = Lazy<map<string, Scalar>>();
+}
+
+// split a solution without the reference node into node voltages, source
+// currents and inductor currents
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::setSolution(const vector<Scalar> &x)
+{
+    this->nodeVoltages.assign(1, Scalar(0));
+    this->nodeVoltages.insert(nodeVoltages.end(), x.begin(), x.begin() + numNodes - 1);
+    this->sourceCurrents.assign(x.begin() + numNodes - 1, x.begin() + numNodes - 1 + batteries.size());
+    this->inductorCurrents.assign(x.begin() + numNodes - 1 + batteries.size(), x.end());
 }
 
-vector<double> computeFactors(vector<vector<double>> *matrix_ptr, int depth)
+// Solves with the pivoted LU factorization of the assembled matrix and keeps
+// the factors, so reloads, effective resistances, sensitivities and
+// refinement solve with them instead of factoring again. The matrix is
+// factored in place, leaving one dense n x n array per circuit, a column at
+// a time to report progress and check for cancellation.
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::makeConductanceMatrices(LoadProgress *progress, const OutOfCoreOptions *outOfCore)
 {
-    vector<double> factors;
-    for (long long unsigned int i = depth + 1; i < matrix_ptr->size(); i++)
+    if (needsOutOfCore(outOfCore))
     {
-        if ((*matrix_ptr)[depth][depth] != 0)
-        {
-            factors.push_back((*matrix_ptr)[i][depth] / (*matrix_ptr)[depth][depth]);
-        }
-        else
+        solveOutOfCore(*outOfCore, progress);
+        return;
+    }
+
+    assembleSourceVector();
+    BasicLUFactorization<Scalar> factors = BasicLUFactorization<Scalar>::unfactored(getConductanceMatrix());
+    if (progress != nullptr)
+    {
+        progress->phase = LoadProgress::SOLVING;
+        progress->percent = 0;
+    }
+
+    int size = factors.size();
+    for (int k = 0; k < size; k++)
+    {
+        if (progress != nullptr)
         {
-            // Handle potential division by zero, for instance by throwing an exception
+            if (progress->cancelled)
+                throw LoadCancelled();
+
+            // column k costs about (size - k)^2, so the work left is about
+            // (size - k)^3 out of size^3
+            double remaining = double(size - k) / size;
+            progress->percent = int(100 * (1 - remaining * remaining * remaining));
         }
+        factors.factorColumn(k);
+    }
+
+    setSolution(factors.solve(sourceVector));
+    factorization.set(make_shared<const BasicLUFactorization<Scalar>>(move(factors)));
+}
+
+// the same components between the same nodes, whatever their values
+template <typename Index, typename Scalar>
+static bool sameNodes(const vector<tuple<Index, Index, Scalar>> &a, const vector<tuple<Index, Index, Scalar>> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (get<0>(a[i]) != get<0>(b[i]) || get<1>(a[i]) != get<1>(b[i]))
+            return false;
+    }
+    return true;
+}
+
+template <typename Instance>
+static bool sameSubcircuits(const vector<Instance> &a, const vector<Instance> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].name != b[i].name || a[i].nodes != b[i].nodes)
+            return false;
+        if (a[i].model != b[i].model && (a[i].model->admittance != b[i].model->admittance ||
+                                         a[i].model->nortonCurrents != b[i].model->nortonCurrents))
+            return false;
     }
-    return factors;
+    return true;
 }
 
-void forwardElimination(vector<vector<double>> *matrix_ptr, vector<double> factors, int depth)
+// Solve with the factors previous was solved with (or its own factorization)
+// instead of eliminating the system again. Returns false if the matrix has
+// changed too much for that, leaving the circuit to be solved in full.
+//
+// Changed resistors make the matrix A + U D U^T, where each column of U is
+// e_i - e_j for the nodes of a changed conductance and D holds the changes.
+// With y = A^-1 b and Z = A^-1 U (one solve per change), Sherman-Morrison-
+// Woodbury gives x = y - Z w where (I + D U^T Z) w = D U^T y, a system the
+// size of the number of changes.
+template <typename Scalar, typename Index>
+bool BasicCircuit<Scalar, Index>::reuseFactorization(const BasicCircuit &previous, LoadProgress *progress)
 {
-    int currentRowIndex = depth + 1;
-    long long unsigned int factorIndex = 0;
-    while (factorIndex < factors.size())
+    if (previous.outOfCore || numNodes != previous.numNodes || !sameNodes(batteries, previous.batteries) ||
+        !sameNodes(inductors, previous.inductors) || !sameSubcircuits(subcircuits, previous.subcircuits) ||
+        getFloatingNodes() != previous.getFloatingNodes())
+        return false;
+
+    // conductance changes relative to the reload factors, by node pair
+    map<pair<Index, Index>, Scalar> changes;
+    for (const ConductanceUpdate &update : previous.conductanceUpdates)
+        changes[{update.node1, update.node2}] += update.conductance;
+    auto addStamp = [&changes](const tuple<Index, Index, Scalar> &resistor, Scalar sign) {
+        Index i = get<0>(resistor), j = get<1>(resistor);
+        if (i != j)
+            changes[{min(i, j), max(i, j)}] += sign * (Scalar(1) / get<2>(resistor));
+    };
+    for (size_t i = 0; i < max(resistors.size(), previous.resistors.size()); i++)
     {
-        // Multiply the row at 'depth' by the current factor and store in new vector
-        vector<double> diffRow;
-        for (long long unsigned int j = depth; j < (*matrix_ptr)[0].size(); j++)
+        if (i < resistors.size() && i < previous.resistors.size() && resistors[i] == previous.resistors[i])
+            continue;
+        if (i < previous.resistors.size())
+            addStamp(previous.resistors[i], Scalar(-1));
+        if (i < resistors.size())
+            addStamp(resistors[i], Scalar(1));
+    }
+
+    conductanceUpdates.clear();
+    for (const auto &change : changes)
+    {
+        if (change.second != Scalar(0))
+            conductanceUpdates.push_back({change.first.first, change.first.second, change.second});
+    }
+
+    // past about a sixteenth of the rows the correction costs as much as refactoring
+    size_t size = getSystemSize();
+    if (conductanceUpdates.size() * 16 > size)
+    {
+        conductanceUpdates.clear();
+        return false;
+    }
+
+    reloadFactors = previous.reloadFactors != nullptr ? previous.reloadFactors : previous.getSharedFactorization();
+    if (reloadFactors->singular)
+    {
+        reloadFactors = nullptr;
+        conductanceUpdates.clear();
+        return false;
+    }
+
+    assembleSourceVector();
+    if (progress != nullptr)
+    {
+        progress->phase = LoadProgress::SOLVING;
+        progress->percent = 0;
+    }
+    vector<Scalar> x = reloadFactors->solve(sourceVector);
+
+    size_t k = conductanceUpdates.size();
+    if (k == 0)
+    {
+        // the matrix is the one the factors were made for
+        solveMethod = SAME_MATRIX;
+        factorization.set(reloadFactors);
+    }
+    else
+    {
+        solveMethod = LOW_RANK_UPDATE;
+
+        // U^T v for the node pair of an update, with ground left out
+        auto difference = [](const vector<Scalar> &v, const ConductanceUpdate &update) {
+            Scalar vi = update.node1 == 0 ? Scalar(0) : v[update.node1 - 1];
+            Scalar vj = update.node2 == 0 ? Scalar(0) : v[update.node2 - 1];
+            return vi - vj;
+        };
+
+        vector<vector<Scalar>> Z;
+        Z.reserve(k);
+        for (const ConductanceUpdate &update : conductanceUpdates)
         {
-            diffRow.push_back((*matrix_ptr)[depth][j] * factors[factorIndex]);
+            if (progress != nullptr && progress->cancelled)
+                throw LoadCancelled();
+            if (progress != nullptr)
+                progress->percent = 100 * Z.size() / k;
+
+            vector<Scalar> u(size, Scalar(0));
+            if (update.node1 != 0)
+                u[update.node1 - 1] += Scalar(1);
+            if (update.node2 != 0)
+                u[update.node2 - 1] -= Scalar(1);
+            Z.push_back(reloadFactors->solve(u));
         }
 
-        // Subtract the new vector from the current row
-        for (long long unsigned int i = depth; i < (*matrix_ptr)[currentRowIndex].size(); i++)
+        vector<vector<Scalar>> S(k, vector<Scalar>(k));
+        vector<Scalar> r(k);
+        for (size_t a = 0; a < k; a++)
         {
-            (*matrix_ptr)[currentRowIndex][i] -= diffRow[i - depth];
+            const ConductanceUpdate &update = conductanceUpdates[a];
+            for (size_t m = 0; m < k; m++)
+                S[a][m] = (a == m ? Scalar(1) : Scalar(0)) + update.conductance * difference(Z[m], update);
+            r[a] = update.conductance * difference(x, update);
         }
 
-        currentRowIndex++;
-        factorIndex++;
+        vector<Scalar> w = BasicLUFactorization<Scalar>(S).solve(r);
+        for (size_t m = 0; m < k; m++)
+        {
+            for (size_t i = 0; i < size; i++)
+                x[i] -= Z[m][i] * w[m];
+        }
     }
-}
 
-vector<double> Circuit::solveMatrix(vector<vector<double>> *matrix_ptr, int depth = 0)
-{
-    // printMatrix(*matrix_ptr);
-    ensureZerosAtBottom(matrix_ptr, depth);
-    // printMatrix(*matrix_ptr);
+    setSolution(x);
+    return true;
+}
 
-    vector<double> factors = computeFactors(matrix_ptr, depth);
-    forwardElimination(matrix_ptr, factors, depth);
-    // printMatrix(*matrix_ptr);
 
-    if ((matrix_ptr->size() - depth) > 1)
+void transpose(vector<vector<int>> matrix)
+{
+    for (size_t i = 0; i < matrix.size(); i++)
     {
-        solveMatrix(matrix_ptr, depth + 1);
+        for (size_t j = 0; j < matrix[0].size(); j++)
+        {
+            int temp = matrix[i][j];
+            matrix[i][j] = matrix[j][i];
+            matrix[j][i] = temp;
+        }
     }
+}
 
-    double cost = 0;
-    for (long long unsigned int i = depth + 1; i < (*matrix_ptr)[0].size() - 1; i++)
-    {
-        cost += (*matrix_ptr)[depth][i] * (*matrix_ptr)[i][(*matrix_ptr)[0].size() - 1];
-        (*matrix_ptr)[depth][i] = 0;
-    }
-    (*matrix_ptr)[depth][(*matrix_ptr)[0].size() - 1] -= cost;
-    (*matrix_ptr)[depth][(*matrix_ptr)[0].size() - 1] /= (*matrix_ptr)[depth][depth];
-    (*matrix_ptr)[depth][depth] = 1;
+void multiply(vector<vector<int>> matrix, vector<vector<int>> matrix2)
+{
+    vector<vector<int>> result;
+    result.resize(matrix.size(), vector<int>(matrix2[0].size(), 0));
 
-    // printMatrix(*matrix_ptr);
-    // Return last column as a vector
-    vector<double> result;
-    for (long long unsigned int i = 0; i < matrix_ptr->size(); i++)
+    for (size_t i = 0; i < matrix.size(); i++)
     {
-        result.push_back((*matrix_ptr)[i][matrix_ptr->size()]);
+        for (size_t j = 0; j < matrix2[0].size(); j++)
+        {
+            for (size_t k = 0; k < matrix[0].size(); k++)
+            {
+                result[i][j] += matrix[i][k] * matrix2[k][j];
+            }
+        }
     }
-    return result;
 }
 
-void Circuit::addBattery(istringstream &in)
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::addBattery(istringstream &in)
 {
     string name, source, destination, voltage;
 
@@ -401,11 +1245,12 @@ void Circuit::addBattery(istringstream &in)
     getline(in, destination, ' ');
     getline(in, voltage, ' ');
 
-    tuple<int, int, double> battery = make_tuple(stoi(source), stoi(destination), stod(voltage));
+    tuple<Index, Index, Scalar> battery = make_tuple(Index(stoll(source)), Index(stoll(destination)), Scalar(stold(voltage)));
     this->batteries.push_back(battery);
 }
 
-void Circuit::addResistor(istringstream &in)
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::addResistor(istringstream &in)
 {
     string name, source, destination, resistance;
 
@@ -414,117 +1259,90 @@ void Circuit::addResistor(istringstream &in)
     getline(in, destination, ' ');
     getline(in, resistance, ' ');
 
-    tuple<int, int, double> resistor = make_tuple(stoi(source), stoi(destination), stod(resistance));
+    tuple<Index, Index, Scalar> resistor = make_tuple(Index(stoll(source)), Index(stoll(destination)), Scalar(stold(resistance)));
     this->resistors.push_back(resistor);
 }
 
-// add new column to existing matrix
-vector<vector<double>> Circuit::getMatrixWithNewColumn(vector<vector<double>> *matrix_ptr, const vector<double> &newColumn) const
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::addCapacitor(istringstream &in)
 {
-    // Check if the new column has the same number of rows as the existing matrix
-    if (newColumn.size() != matrix_ptr->size())
-    {
-        // Handle error: Number of rows in the new column must match the existing matrix
-        return *matrix_ptr; // Return the original matrix if there is an error
-    }
-
-    // Create a new matrix by copying the original matrix
-    vector<vector<double>> newMatrix = *matrix_ptr;
+    string name, source, destination, capacitance;
 
-    // Add the new column to the new matrix
-    for (long long unsigned int i = 0; i < newMatrix.size(); ++i)
-    {
-        newMatrix[i].push_back(newColumn[i]);
-    }
+    getline(in, name, ' ');
+    getline(in, source, ' ');
+    getline(in, destination, ' ');
+    getline(in, capacitance, ' ');
 
-    // Return the new matrix with the added column
-    return newMatrix;
+    tuple<Index, Index, Scalar> capacitor = make_tuple(Index(stoll(source)), Index(stoll(destination)), Scalar(stold(capacitance)));
+    this->capacitors.push_back(capacitor);
 }
 
-vector<vector<double>> Circuit::getMatrixWithNewColumn(const vector<double> &newColumn) const
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::addInductor(istringstream &in)
 {
-    // Check if the new column has the same number of rows as the existing matrix
-    if (newColumn.size() != branchIncidenceMatrix.size())
-    {
-        // Handle error: Number of rows in the new column must match the existing matrix
-        return branchIncidenceMatrix; // Return the original matrix if there is an error
-    }
-
-    // Create a new matrix by copying the original matrix
-    vector<vector<double>> newMatrix = branchIncidenceMatrix;
-
-    // Add the new column to the new matrix
-    for (long long unsigned int i = 0; i < newMatrix.size(); ++i)
-    {
-        newMatrix[i].push_back(newColumn[i]);
-    }
+    string name, source, destination, inductance;
 
-    // Return the new matrix with the added column
-    return newMatrix;
-}
-
-vector<double> Circuit::getCurrentVector()
-{
-    int nrows = this->branchIncidenceMatrix.size();
-    vector<double> zero_vector(nrows, 0.0);
-    vector<vector<double>> incidence_mat_with_0 = Circuit::getMatrixWithNewColumn(zero_vector);
-    // print current vlaues
+    getline(in, name, ' ');
+    getline(in, source, ' ');
+    getline(in, destination, ' ');
+    getline(in, inductance, ' ');
 
-    // vector<double> current_vector = solveMatrix(&incidence_mat_with_0);
-    return vector<double>();
+    tuple<Index, Index, Scalar> inductor = make_tuple(Index(stoll(source)), Index(stoll(destination)), Scalar(stold(inductance)));
+    this->inductors.push_back(inductor);
 }
 
-vector<double> Circuit::getVoltageDrop()
+// reduce a subcircuit definition to its ports, once per definition
+template <typename Scalar, typename Index>
+shared_ptr<const BasicPortModel<Scalar, Index>> BasicCircuit<Scalar, Index>::getSubcircuitModel(const string &name, SubcircuitLibrary &library)
 {
-    vector<double> currentVector = Circuit::getCurrentVector();
-    vector<double> voltageDropVector(currentVector.size(), 0);
-    int idx = 0;
-    for (const tuple<int, int, double> &tuple : this->batteries)
-    {
-        voltageDropVector[idx] = double(get<2>(tuple));
-        idx++;
-    }
-    for (const tuple<int, int, double> &tuple : this->resistors)
-    {
-        voltageDropVector[idx] = double(currentVector[idx] * (get<2>(tuple)));
-        idx++;
-    }
-    return voltageDropVector;
+    auto model = library.models.find(name);
+    if (model != library.models.end())
+        return model->second;
+
+    auto definition = library.definitions.find(name);
+    if (definition == library.definitions.end())
+        throw invalid_argument("subcircuit " + name + " is not defined");
+    string_view key = definition->first;
+    if (!library.reducing.insert(key).second)
+        throw invalid_argument("subcircuit " + name + " instantiates itself");
+
+    const pmr::vector<Index> &ports = definition->second.first;
+    BasicCircuit circuit(definition->second.second, library);
+    shared_ptr<const PortModel> reduced = make_shared<const PortModel>(circuit, vector<Index>(ports.begin(), ports.end()));
+
+    library.reducing.erase(key);
+    library.models[key] = reduced;
+    return reduced;
 }
 
-vector<double> Circuit::getVotlageNodes()
+template <typename Scalar, typename Index>
+void BasicCircuit<Scalar, Index>::addSubcircuit(istringstream &in, SubcircuitLibrary &library)
 {
-    vector<double> voltageDropVec = Circuit::getVoltageDrop();
-    vector<vector<double>> incidence_mat_with_voltage_drop = Circuit::getMatrixWithNewColumn(voltageDropVec);
-    vector<double> nodesVector = solveMatrix(&incidence_mat_with_voltage_drop);
-    return nodesVector;
-}
-
-vector<double> Circuit::getResistorCurrents(){
-
-    vector<double> resistorCurrentVec(this->resistors.size(),0);
-    int i = 0;
-    for (const tuple<int, int, double> &tuple : this->resistors){
-        int source_idx =(int)get<0>(tuple);
-        int dest_idx =(int)get<1>(tuple);
-        int R = get<2>(tuple);
-        resistorCurrentVec[i] = (this->nodeVoltages[source_idx] - this->nodeVoltages[dest_idx])/R;
-        // cout << "Current through resistor " << i << ": " << resistorCurrentVec[i] << " A" << endl;
-        i++;
-    }
-    
-    return resistorCurrentVec;
+    SubcircuitInstance instance;
+    string label;
+    Index node;
+
+    in >> label >> instance.name;
+    while (in >> node)
+        instance.nodes.push_back(node);
+
+    instance.model = getSubcircuitModel(instance.name, library);
+    if (instance.model->ports.size() != instance.nodes.size())
+        throw invalid_argument(label + " connects " + to_string(instance.nodes.size()) + " nodes to " +
+                               instance.name + " which has " + to_string(instance.model->ports.size()) + " ports");
+    this->subcircuits.push_back(instance);
 }
 
 // Function to calculate the total resistance between a series of node pairs
-double Circuit::getCurrentFromPoints(const std::vector<std::pair<int, int>>& nodePairs) {
-    double totalResistance = 0.0;
-    double totalVoltage = 0.0;
+template <typename Scalar, typename Index>
+Scalar BasicCircuit<Scalar, Index>::getCurrentFromPoints(const std::vector<std::pair<Index, Index>>& nodePairs) const {
+    Scalar totalResistance = Scalar(0);
+    Scalar totalVoltage = Scalar(0);
 
     for (const auto& nodePair : nodePairs) {
-        double pathResistance = 0.0;
+        Scalar pathResistance = Scalar(0);
         bool resistorFound = false;
-        double pathVoltage = 0.0;
+        Scalar pathVoltage = Scalar(0);
 
         // For each node pair, find the corresponding resistors
         for (const auto& resistor : resistors) {
@@ -544,8 +1362,8 @@ double Circuit::getCurrentFromPoints(const std::vector<std::pair<int, int>>& nod
             for (const auto& battery : batteries) {
                 if ((std::get<0>(battery) == nodePair.first && std::get<1>(battery) == nodePair.second) ||
                     (std::get<0>(battery) == nodePair.second && std::get<1>(battery) == nodePair.first)) { // Considering bidirectional
-                    pathResistance = 0.0;
-                    pathVoltage = 0.0;
+                    pathResistance = Scalar(0);
+                    pathVoltage = Scalar(0);
                     resistorFound = true;
                 }
             }
@@ -554,7 +1372,7 @@ double Circuit::getCurrentFromPoints(const std::vector<std::pair<int, int>>& nod
         if (!resistorFound) {
             //Check if battery exists here first
             std::cerr << "No resistor found for node pair (" << nodePair.first << ", " << nodePair.second << ")" << std::endl;
-            return -1; // Error code for "resistor not found"
+            return Scalar(-1); // Error code for "resistor not found"
         }
 
         totalResistance += pathResistance; // Resistors in series are added
@@ -567,9 +1385,118 @@ double Circuit::getCurrentFromPoints(const std::vector<std::pair<int, int>>& nod
 }
 
 
-double Circuit::getVoltageFromPoints(int node1, int node2)
+template <typename Scalar, typename Index>
+Scalar BasicCircuit<Scalar, Index>::getVoltageFromPoints(Index node1, Index node2) const
 {
-    double v1 = nodeVoltages[node1];
-    double v2 = nodeVoltages[node2];
+    Scalar v1 = nodeVoltages[node1];
+    Scalar v2 = nodeVoltages[node2];
     return v1 - v2;
-}
\ No newline at end of file
+}
+
+// number of nodes including ground
+template <typename Scalar, typename Index>
+Index BasicCircuit<Scalar, Index>::getNodeCount() const
+{
+    return numNodes;
+}
+
+template <typename Scalar, typename Index>
+typename BasicCircuit<Scalar, Index>::SolveMethod BasicCircuit<Scalar, Index>::getSolveMethod() const
+{
+    return solveMethod;
+}
+
+template <typename Scalar, typename Index>
+bool BasicCircuit<Scalar, Index>::isOutOfCore() const
+{
+    return outOfCore;
+}
+
+template <typename Scalar, typename Index>
+size_t BasicCircuit<Scalar, Index>::getConductanceUpdateCount() const
+{
+    return conductanceUpdates.size();
+}
+
+template <typename Scalar, typename Index>
+size_t BasicCircuit<Scalar, Index>::getFactorizationBytes() const
+{
+    if (outOfCore)
+        return 0;
+    size_t size = getSystemSize();
+    size_t bytes = size * (sizeof(vector<Scalar>) + size * sizeof(Scalar) + sizeof(int));
+
+    // factors reused unchanged are the circuit's own
+    if (reloadFactors != nullptr && solveMethod != SAME_MATRIX)
+        bytes *= 2;
+    return bytes;
+}
+
+// factorization of the conductance matrix, computed on first use
+template <typename Scalar, typename Index>
+const BasicLUFactorization<Scalar> &BasicCircuit<Scalar, Index>::getFactorization() const
+{
+    return *getSharedFactorization();
+}
+
+// the same, shared with the circuits reloaded from this one
+template <typename Scalar, typename Index>
+const shared_ptr<const BasicLUFactorization<Scalar>> &BasicCircuit<Scalar, Index>::getSharedFactorization() const
+{
+    if (outOfCore)
+        throw logic_error("the conductance matrix was factored out of core and not kept");
+    return factorization.get([this]() { return make_shared<const BasicLUFactorization<Scalar>>(getConductanceMatrix()); });
+}
+
+// resistance between two nodes with every voltage source shorted, found by
+// injecting a unit current at node1 and drawing it out at node2
+template <typename Scalar, typename Index>
+Scalar BasicCircuit<Scalar, Index>::getEffectiveResistance(Index node1, Index node2) const
+{
+    if (outOfCore)
+        throw logic_error("the conductance matrix was factored out of core and not kept");
+    if (node1 < 0 || node1 >= numNodes || node2 < 0 || node2 >= numNodes)
+        throw invalid_argument("node " + to_string(node1 < 0 || node1 >= numNodes ? node1 : node2) +
+                               " is not a node of the circuit");
+    if (node1 == node2)
+        return Scalar(0);
+
+    // no current can flow between groups that only capacitors connect
+    vector<Index> group = getDcGroups();
+    if (group[node1] != group[node2])
+        return Scalar(numeric_limits<typename RealType<Scalar>::type>::infinity());
+
+    vector<Scalar> injection(getSystemSize(), Scalar(0));
+    if (node1 != 0)
+        injection[node1 - 1] += Scalar(1);
+    if (node2 != 0)
+        injection[node2 - 1] -= Scalar(1);
+
+    vector<Scalar> x = getFactorization().solve(injection);
+    Scalar v1 = node1 == 0 ? Scalar(0) : x[node1 - 1];
+    Scalar v2 = node2 == 0 ? Scalar(0) : x[node2 - 1];
+    return v1 - v2;
+}
+
+// current that would flow through a wire connecting node1 to node2, the
+// Thevenin voltage between them divided by their effective resistance
+template <typename Scalar, typename Index>
+Scalar BasicCircuit<Scalar, Index>::getShortCircuitCurrent(Index node1, Index node2) const
+{
+    Scalar resistance = getEffectiveResistance(node1, node2);
+    return getVoltageFromPoints(node1, node2) / resistance;
+}
+
+// the value and node number types the circuit core is compiled for; every
+// instantiation adds about a megabyte of code, so only Circuit is built by
+// default
+template struct BasicCircuit<double, int32_t>;
+#ifdef CIRCUIT_ALL_TYPES
+template struct BasicCircuit<float, int32_t>;
+template struct BasicCircuit<float, int64_t>;
+template struct BasicCircuit<double, int64_t>;
+template struct BasicCircuit<long double, int32_t>;
+template struct BasicCircuit<long double, int64_t>;
+template struct BasicCircuit<complex<double>, int32_t>;
+template struct BasicCircuit<complex<double>, int64_t>;
+#endif
@@ -1,34 +1,203 @@
+#ifndef CIRCUIT_H
+#define CIRCUIT_H
+
+#include <atomic>
 #include <vector>
 #include <tuple>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <iomanip>
 #include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <complex>
+#include <cstdint>
+#include <cstdlib>
+#include <memory_resource>
+#include <stdexcept>
+
+#include "lazy.h"
+#include "lu.h"
 
 using namespace std;
 
-struct Circuit
+template <typename Scalar, typename Index>
+struct BasicPortModel;
+
+// Progress of a circuit being loaded, readable from other threads while the
+// load runs. Setting cancelled makes the load throw LoadCancelled at its next
+// check, done for every component parsed and every column factored.
+struct LoadProgress
+{
+    enum Phase
+    {
+        PARSING,
+        ASSEMBLING,
+        SOLVING,
+        DONE
+    };
+
+    atomic<Phase> phase;
+    atomic<int> percent; // of the current phase
+    atomic<bool> cancelled;
+
+    LoadProgress() : phase(PARSING), percent(0), cancelled(false) {}
+};
+
+struct LoadCancelled : runtime_error
+{
+    LoadCancelled() : runtime_error("load cancelled") {}
+};
+
+// Conductance matrices larger than the memory budget are assembled and
+// factored in a scratch file in directory instead of RAM (see mapped.h)
+struct OutOfCoreOptions
+{
+    string directory;
+    size_t memoryBudget = 0; // bytes
+};
+
+// underlying real type of a scalar, e.g. double for complex<double>
+template <typename T>
+struct RealType
 {
+    typedef T type;
+};
+
+template <typename T>
+struct RealType<complex<T>>
+{
+    typedef T type;
+};
+
+// read a value written with <<, which unlike >> also takes back the nan and
+// inf that << writes for non-finite values
+template <typename T>
+bool readScalar(istream &in, T &value)
+{
+    string token;
+    if (!(in >> token))
+        return false;
+    char *end;
+    value = strtold(token.c_str(), &end);
+    return end == token.c_str() + token.size() && !token.empty();
+}
+
+// a complex value is written as (real,imaginary)
+template <typename T>
+bool readScalar(istream &in, complex<T> &value)
+{
+    string token;
+    if (!(in >> token) || token.size() < 5 || token.front() != '(' || token.back() != ')')
+        return false;
+    size_t comma = token.find(',');
+    if (comma == string::npos)
+        return false;
+    istringstream real(token.substr(1, comma - 1)), imaginary(token.substr(comma + 1, token.size() - comma - 2));
+    T re, im;
+    if (!readScalar(real, re) || !readScalar(imaginary, im))
+        return false;
+    value = complex<T>(re, im);
+    return true;
+}
+
+// A circuit and its DC solution, with component values and solved quantities
+// stored as Scalar and node numbers as Index. The tool uses Circuit (double
+// and int), the only instantiation in circuit.cpp by default; building with
+// CIRCUIT_ALL_TYPES defined (make ALL_TYPES=1) also instantiates float,
+// long double and complex<double> values with 32 and 64-bit node numbers.
+// Smaller types roughly halve the memory of large grids, at the cost of
+// precision.
+template <typename Scalar, typename Index>
+struct BasicCircuit
+{
+    typedef BasicPortModel<Scalar, Index> PortModel;
+
+    // A subcircuit instance: the nodes its ports connect to and the port model
+    // shared by every instance of the same subcircuit
+    struct SubcircuitInstance
+    {
+        string name;
+        vector<Index> nodes;
+        shared_ptr<const PortModel> model;
+    };
+
+    // Subcircuit definitions of a netlist, each reduced to a port model the
+    // first time it is instantiated. Names are viewed in the netlist and the
+    // containers are allocated from memory, like the rest of the parse
+    struct SubcircuitLibrary
+    {
+        pmr::map<string_view, pair<pmr::vector<Index>, string_view>> definitions; // ports and body lines
+        pmr::map<string_view, shared_ptr<const PortModel>> models;
+        pmr::set<string_view> reducing; // definitions being reduced, to catch recursion
+        pmr::memory_resource *memory;   // for load temporaries
+        LoadProgress *progress = nullptr;            // of the top-level load
+        const OutOfCoreOptions *outOfCore = nullptr; // nullptr to always solve in RAM
+
+        SubcircuitLibrary(pmr::memory_resource *memory = pmr::get_default_resource())
+            : definitions(memory), models(memory), reducing(memory), memory(memory)
+        {
+        }
+    };
+
     // member variables
-    typedef vector<tuple<int, int, double>> tupleVector;
+    typedef vector<tuple<Index, Index, Scalar>> tupleVector;
     tupleVector batteries;
     tupleVector resistors;
+    tupleVector capacitors;
+    tupleVector inductors;
+    vector<SubcircuitInstance> subcircuits;
 
     // Node Voltages
-    vector<double> nodeVoltages;
+    vector<Scalar> nodeVoltages;
 
     // Source currents
-    vector<double> sourceCurrents;
-    vector<double> resistorCurrents;
-    map<string, double> currents;
-    map<string, double> voltages;
-    map<string, double> nodeToNames;
+    vector<Scalar> sourceCurrents;
+    vector<Scalar> inductorCurrents;
+
+    // right-hand side of the MNA system without the reference node: node k
+    // is row k - 1, followed by one row per voltage source and then one per
+    // inductor
+    vector<Scalar> sourceVector;
 
-    vector<vector<double>> branchIncidenceMatrix;
+    // how the DC solution of a circuit was found
+    enum SolveMethod
+    {
+        FULL_SOLVE,      // the whole system was factored
+        SAME_MATRIX,     // reload: only sources changed, factors reused
+        LOW_RANK_UPDATE, // reload: resistors changed, factors reused with a correction
+        REFINED_SOLVE    // solved again with refineSolution()
+    };
 
     // constructors
-    Circuit();
-    Circuit(string netList);
+    BasicCircuit();
+    BasicCircuit(string netList);
+    BasicCircuit(istream &netList, pmr::memory_resource *memory = pmr::get_default_resource(),
+                 LoadProgress *progress = nullptr, const OutOfCoreOptions *outOfCore = nullptr);
+
+    // the same from netlist contents already in memory, parsed in place
+    // without copying them
+    BasicCircuit(string_view netList, pmr::memory_resource *memory, LoadProgress *progress = nullptr,
+                 const OutOfCoreOptions *outOfCore = nullptr);
+
+    // An edited version of a loaded netlist, solved by reusing the factorization
+    // of previous when the matrix structure is unchanged: source values
+    // and capacitors only change the right-hand side, and resistors changed,
+    // added or removed between existing nodes are a low-rank correction.
+    // Anything else (new nodes, sources, inductors, subcircuit changes or
+    // different floating nodes), or too many changed resistors, is solved in full
+    BasicCircuit(const BasicCircuit &previous, string_view netList,
+                 pmr::memory_resource *memory = pmr::get_default_resource(), LoadProgress *progress = nullptr,
+                 const OutOfCoreOptions *outOfCore = nullptr);
+
+    // a solved circuit is large, it is moved or shared (see circuitHandle)
+    // but never copied
+    BasicCircuit(const BasicCircuit &) = delete;
+    BasicCircuit &operator=(const BasicCircuit &) = delete;
+    BasicCircuit(BasicCircuit &&) = default;
+    BasicCircuit &operator=(BasicCircuit &&) = default;
 
     // public methods
     void printBatteries();
@@ -36,21 +205,119 @@ struct Circuit
     void printNodeVoltages();
     void printSourceCurrents();
     void printBranchIncidenceMatrix();
-    vector<double> getCurrentVector();
-    vector<vector<double>> getMatrixWithNewColumn(const vector<double>& newColumn) const;
-    vector<vector<double>> getMatrixWithNewColumn(vector<vector<double>> *matrix_ptr, const vector<double> &newColumn) const;
-    vector<double> getVoltageDrop();
-    vector<double> getVotlageNodes();
-    vector<double> getResistorCurrents();
-    double getCurrentFromPoints(const std::vector<std::pair<int, int>>& nodePairs);
-    bool checkNodeListValidity(vector<pair<int, int>> nodePairs);
-    double getVoltageFromPoints(int node1, int node2);
+
+    // results derived from the node voltages, computed on first use and kept
+    const vector<Scalar> &getResistorCurrents() const;
+    const map<string, Scalar> &getCurrents() const; // by component name, e.g. V1, R2, C1, L1
+    const map<string, Scalar> &getVoltages() const; // by node name, e.g. V0, V3
+    const vector<vector<Scalar>> &getBranchIncidenceMatrix() const;
+
+    // a subset of the results, computed without building the ones above
+    vector<Scalar> getNodeVoltages(const vector<Index> &nodes) const;
+    Scalar getResistorCurrent(size_t resistor) const; // 0 based
+    vector<Scalar> getResistorCurrents(const vector<size_t> &resistors) const;
+    bool getCurrent(const string &name, Scalar &current) const; // false if there is no such component
+
+    Scalar getCurrentFromPoints(const std::vector<std::pair<Index, Index>>& nodePairs) const;
+    bool checkNodeListValidity(const vector<pair<Index, Index>> &nodePairs);
+    Scalar getVoltageFromPoints(Index node1, Index node2) const;
+
+    // the MNA matrix in the same order, assembled on every call since only
+    // its factors are kept; throws logic_error out of core
+    vector<vector<Scalar>> getConductanceMatrix() const;
+    size_t getSystemSize() const;
+    const BasicLUFactorization<Scalar> &getFactorization() const;
+    // both throw logic_error out of core and invalid_argument for a node the
+    // circuit does not have. Nodes with no DC path between them, such as a
+    // node only capacitors connect, are an open circuit: infinite resistance
+    // and no current
+    Scalar getEffectiveResistance(Index node1, Index node2) const;
+    Scalar getShortCircuitCurrent(Index node1, Index node2) const;
+    Index getNodeCount() const;
+    SolveMethod getSolveMethod() const;
+
+    // solve again with the LU factorization and a few steps of iterative
+    // refinement, for a solution that failed its check (see verify.h); not
+    // available out of core
+    void refineSolution(int iterations = 2);
+
+    // solved out of core: only the solution is kept, so the analyses that need
+    // the conductance matrix or its factorization are not available
+    bool isOutOfCore() const;
+
+    // one node of each group that only capacitors connect to the rest of the
+    // circuit, sorted. Such a group has no DC path to ground, so the DC
+    // matrix ties that node to ground with a unit conductance, which fixes the
+    // group's voltage and carries no current since nothing else leaves the
+    // group at DC. Transient and AC analysis take the ties out again, and so
+    // do port models for the groups holding a port
+    vector<Index> getFloatingNodes() const;
+
+    // a group number for every node, the same for nodes joined by branches
+    // that conduct at DC (resistors, voltage sources, inductors); subcircuit
+    // ports count as joined to ground
+    vector<Index> getDcGroups() const;
+    size_t getConductanceUpdateCount() const; // resistor stamps corrected since the last full solve
+
+    // bytes of the LU factors this circuit holds: its own, built by a full
+    // load and otherwise on first use, and the earlier factors a reload
+    // corrects, which may be shared with other circuits
+    size_t getFactorizationBytes() const;
+    void write(ostream &out) const;
+    bool read(istream &in);
 
     // private methods
 private:
+    BasicCircuit(string_view netList, SubcircuitLibrary &library);
+    void load(string_view netList, SubcircuitLibrary &library, bool solve);
+    void parse(string_view netList, SubcircuitLibrary &library, bool reporting);
+    bool reuseFactorization(const BasicCircuit &previous, LoadProgress *progress);
+    const shared_ptr<const BasicLUFactorization<Scalar>> &getSharedFactorization() const;
+    void addSubcircuit(istringstream& in, SubcircuitLibrary &library);
+    static shared_ptr<const PortModel> getSubcircuitModel(const string &name, SubcircuitLibrary &library);
+    void countNodes();
+    map<string, Scalar> buildCurrents() const;
+    map<string, Scalar> buildVoltages() const;
     void addBattery(istringstream& in);
     void addResistor(istringstream& in);
-    vector<double> solveMatrix(vector<vector<double>> *matrix_ptr, int depth);
-    void constructBranchIncidenceMatrix();
-    void makeConductanceMatrices();
-};
\ No newline at end of file
+    void addCapacitor(istringstream& in);
+    void addInductor(istringstream& in);
+    vector<vector<Scalar>> constructBranchIncidenceMatrix() const;
+    template <typename Matrix>
+    void stampConductanceMatrix(Matrix &G) const;
+    template <typename Matrix>
+    void stampResistorsInParallel(Matrix &G, unsigned int numThreads) const;
+    void assembleSourceVector();
+    void makeConductanceMatrices(LoadProgress *progress, const OutOfCoreOptions *outOfCore = nullptr);
+    bool needsOutOfCore(const OutOfCoreOptions *options) const;
+    void solveOutOfCore(const OutOfCoreOptions &options, LoadProgress *progress);
+    void setSolution(const vector<Scalar> &x);
+
+    // number of nodes including ground
+    Index numNodes = 0;
+
+    // a change of conductance between two nodes relative to the matrix the
+    // reload factors belong to
+    struct ConductanceUpdate
+    {
+        Index node1, node2;
+        Scalar conductance;
+    };
+
+    SolveMethod solveMethod = FULL_SOLVE;
+    bool outOfCore = false;
+
+    // factors of an earlier matrix that this one differs from by the updates
+    shared_ptr<const BasicLUFactorization<Scalar>> reloadFactors;
+    vector<ConductanceUpdate> conductanceUpdates;
+
+    Lazy<shared_ptr<const BasicLUFactorization<Scalar>>> factorization;
+    Lazy<vector<Scalar>> resistorCurrents;
+    Lazy<map<string, Scalar>> currents;
+    Lazy<map<string, Scalar>> voltages;
+    Lazy<vector<vector<Scalar>>> branchIncidenceMatrix;
+};
+
+typedef BasicCircuit<double, int> Circuit;
+
+#endif
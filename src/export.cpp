@@ -0,0 +1,234 @@
+#include "export.h"
+
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+BufferedFileWriter::BufferedFileWriter(const string &path, bool background, size_t bufferSize)
+    : path(path), bufferSize(bufferSize), buffer(bufferSize), used(0), background(background), pendingSize(0),
+      stopping(false)
+{
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw runtime_error("could not open " + path + ": " + strerror(errno));
+
+    if (background)
+    {
+        pending.resize(bufferSize);
+        writer = thread(&BufferedFileWriter::writeInBackground, this);
+    }
+}
+
+BufferedFileWriter::~BufferedFileWriter()
+{
+    try
+    {
+        close();
+    }
+    catch (const exception &)
+    {
+    }
+}
+
+void BufferedFileWriter::write(const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        if (used == bufferSize)
+            flush();
+        size_t chunk = min(size, bufferSize - used);
+        memcpy(buffer.data() + used, data, chunk);
+        used += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void BufferedFileWriter::write(const string &text)
+{
+    write(text.data(), text.size());
+}
+
+char *BufferedFileWriter::reserve(size_t size)
+{
+    if (bufferSize - used < size)
+        flush();
+    if (bufferSize - used < size)
+        throw length_error("reserved more than the buffer holds");
+    return buffer.data() + used;
+}
+
+void BufferedFileWriter::commit(char *end)
+{
+    used = end - buffer.data();
+}
+
+void BufferedFileWriter::close()
+{
+    if (fd < 0)
+        return;
+
+    string failure;
+    try
+    {
+        flush();
+    }
+    catch (const exception &e)
+    {
+        failure = e.what();
+    }
+
+    if (background)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        writer.join();
+        if (failure.empty())
+            failure = error;
+    }
+
+    int result = ::close(fd);
+    fd = -1;
+    if (!failure.empty())
+        throw runtime_error(failure);
+    if (result != 0)
+        throw runtime_error("could not write " + path + ": " + strerror(errno));
+}
+
+// hand the filled buffer to the writer thread, or write it directly
+void BufferedFileWriter::flush()
+{
+    if (used == 0)
+        return;
+
+    if (!background)
+    {
+        writeAll(buffer.data(), used);
+        used = 0;
+        return;
+    }
+
+    unique_lock<mutex> guard(lock);
+    changed.wait(guard, [this]() { return pendingSize == 0 || !error.empty(); });
+    if (!error.empty())
+        throw runtime_error(error);
+    buffer.swap(pending);
+    pendingSize = used;
+    used = 0;
+    guard.unlock();
+    changed.notify_all();
+}
+
+void BufferedFileWriter::writeAll(const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            throw runtime_error("could not write " + path + ": " + strerror(errno));
+        data += written;
+        size -= written;
+    }
+}
+
+void BufferedFileWriter::writeInBackground()
+{
+    unique_lock<mutex> guard(lock);
+    while (true)
+    {
+        changed.wait(guard, [this]() { return pendingSize > 0 || stopping; });
+        if (pendingSize == 0)
+            return;
+
+        // the filling thread only touches pending once pendingSize is back to 0
+        guard.unlock();
+        string failure;
+        try
+        {
+            writeAll(pending.data(), pendingSize);
+        }
+        catch (const exception &e)
+        {
+            failure = e.what();
+        }
+        guard.lock();
+
+        pendingSize = 0;
+        error = failure;
+        changed.notify_all();
+        if (!error.empty())
+            return;
+    }
+}
+
+static void writeCsvValues(BufferedFileWriter &out, const char *prefix, const char *suffix, int firstNumber,
+                           const vector<double> &values)
+{
+    // longest row: the name with a 64-bit number, a double and the separators
+    const size_t maxRowSize = 128;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        char *start = out.reserve(maxRowSize);
+        char *end = start;
+        for (const char *c = prefix; *c; c++)
+            *end++ = *c;
+        end = to_chars(end, start + maxRowSize, firstNumber + (long long)i).ptr;
+        for (const char *c = suffix; *c; c++)
+            *end++ = *c;
+        *end++ = ',';
+        end = to_chars(end, start + maxRowSize, values[i]).ptr;
+        *end++ = '\n';
+        out.commit(end);
+    }
+}
+
+static void writeUint32(BufferedFileWriter &out, uint32_t value)
+{
+    out.write((const char *)&value, sizeof(value));
+}
+
+static void writeBinaryColumn(BufferedFileWriter &out, const string &name, const vector<double> &values)
+{
+    writeUint32(out, name.size());
+    out.write(name);
+    uint64_t count = values.size();
+    out.write((const char *)&count, sizeof(count));
+    out.write((const char *)values.data(), values.size() * sizeof(double));
+}
+
+void exportResults(const Circuit &circuit, const string &path, ExportFormat format, bool background)
+{
+    BufferedFileWriter out(path, background);
+    if (format == EXPORT_CSV)
+    {
+        // shortest representation that reads back to the same double
+        out.write("name,value\n");
+        writeCsvValues(out, "V(", ")", 0, circuit.nodeVoltages);
+        writeCsvValues(out, "I(V", ")", 1, circuit.sourceCurrents);
+        writeCsvValues(out, "I(R", ")", 1, circuit.getResistorCurrents());
+        writeCsvValues(out, "I(L", ")", 1, circuit.inductorCurrents);
+    }
+    else
+    {
+        out.write("CADC", 4);
+        writeUint32(out, 1);
+        writeUint32(out, 4);
+        writeBinaryColumn(out, "nodeVoltages", circuit.nodeVoltages);
+        writeBinaryColumn(out, "sourceCurrents", circuit.sourceCurrents);
+        writeBinaryColumn(out, "resistorCurrents", circuit.getResistorCurrents());
+        writeBinaryColumn(out, "inductorCurrents", circuit.inductorCurrents);
+    }
+    out.close();
+}
@@ -0,0 +1,74 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "circuit.h"
+
+using namespace std;
+
+// File output through one large buffer, handed to the operating system with
+// a single write() call each time it fills up. With a background writer there
+// are two buffers: one is filled while a writer thread writes the other, so
+// formatting and disk writes overlap. Throws runtime_error on I/O errors.
+class BufferedFileWriter
+{
+public:
+    BufferedFileWriter(const string &path, bool background = false, size_t bufferSize = 4 << 20);
+
+    // flushes and closes, errors at this point are ignored; call close() to see them
+    ~BufferedFileWriter();
+
+    void write(const char *data, size_t size);
+    void write(const string &text);
+
+    // room to format at least size bytes in place, committed with commit()
+    char *reserve(size_t size);
+    void commit(char *end);
+
+    void close();
+
+private:
+    string path;
+    int fd;
+    size_t bufferSize;
+    vector<char> buffer; // being filled
+    size_t used;
+
+    // background writer state
+    bool background;
+    thread writer;
+    mutex lock;
+    condition_variable changed;
+    vector<char> pending; // being written
+    size_t pendingSize;
+    bool stopping;
+    string error;
+
+    void flush();
+    void writeAll(const char *data, size_t size);
+    void writeInBackground();
+};
+
+enum ExportFormat
+{
+    EXPORT_CSV,
+    EXPORT_BINARY
+};
+
+// Write every node voltage, source current, resistor current and inductor
+// current of a solved circuit to a file.
+//
+// CSV has a "name,value" header and one row per value, named V(node),
+// I(Vn), I(Rn) and I(Ln) with 1 based component numbers. The binary
+// columnar file is "CADC", then uint32 version and column count, then for
+// each column its name (uint32 length and bytes), uint64 value count and the
+// values as doubles. The columns are nodeVoltages, sourceCurrents,
+// resistorCurrents and inductorCurrents.
+void exportResults(const Circuit &circuit, const string &path, ExportFormat format, bool background = true);
+
+#endif
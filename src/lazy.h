@@ -0,0 +1,49 @@
+#ifndef LAZY_H
+#define LAZY_H
+
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+// A value computed on first use and cached afterwards. Safe to read from
+// several threads at once, the value is computed exactly once. Copies start
+// out empty and compute their own value when first asked, moves take the
+// value along.
+template <typename T>
+class Lazy
+{
+public:
+    Lazy() : flag(new once_flag) {}
+    Lazy(const Lazy &) : flag(new once_flag) {}
+    Lazy(Lazy &&) = default;
+
+    Lazy &operator=(const Lazy &)
+    {
+        flag.reset(new once_flag);
+        value.reset();
+        return *this;
+    }
+
+    Lazy &operator=(Lazy &&) = default;
+
+    template <typename Compute>
+    const T &get(Compute compute) const
+    {
+        call_once(*flag, [&]() { value.reset(new T(compute())); });
+        return *value;
+    }
+
+    // take a value already at hand instead of computing one, unless a value
+    // was computed first
+    void set(T known)
+    {
+        call_once(*flag, [&]() { value.reset(new T(move(known))); });
+    }
+
+private:
+    unique_ptr<once_flag> flag;
+    mutable unique_ptr<T> value;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "loader.h"
+
+using namespace std;
+
+BackgroundLoader::BackgroundLoader(LoadFunction load) : load(load), finished(false) {}
+
+BackgroundLoader::~BackgroundLoader()
+{
+    if (isLoading())
+    {
+        cancel();
+        finish();
+    }
+}
+
+void BackgroundLoader::start(const string &path, circuitHandle previous)
+{
+    if (isLoading())
+    {
+        cancel();
+        finish();
+    }
+
+    this->path = path;
+    progress.phase = LoadProgress::PARSING;
+    progress.percent = 0;
+    progress.cancelled = false;
+    finished = false;
+    result = nullptr;
+    error.clear();
+
+    worker = thread([this, path, previous]() {
+        circuitHandle circuit;
+        try
+        {
+            circuit = load(path, previous, arena, progress);
+        }
+        catch (const LoadCancelled &)
+        {
+        }
+        catch (const exception &e)
+        {
+            error = e.what();
+        }
+
+        result = circuit;
+        finished = true;
+    });
+}
+
+bool BackgroundLoader::isLoading() const
+{
+    return worker.joinable();
+}
+
+bool BackgroundLoader::isFinished() const
+{
+    return isLoading() && finished;
+}
+
+const LoadProgress &BackgroundLoader::getProgress() const
+{
+    return progress;
+}
+
+const string &BackgroundLoader::getPath() const
+{
+    return path;
+}
+
+const string &BackgroundLoader::getError() const
+{
+    return error;
+}
+
+void BackgroundLoader::cancel()
+{
+    progress.cancelled = true;
+}
+
+circuitHandle BackgroundLoader::finish()
+{
+    if (!isLoading())
+        return nullptr;
+    worker.join();
+
+    circuitHandle circuit = result;
+    result = nullptr;
+    return circuit;
+}
@@ -0,0 +1,71 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "arena.h"
+#include "cache.h"
+
+using namespace std;
+
+// Loads one netlist at a time on a worker thread so the caller stays
+// responsive. The caller polls for progress, may cancel, and collects the
+// circuit with finish() once isFinished() says it is ready; until then the
+// circuit it already has is untouched.
+class BackgroundLoader
+{
+public:
+    // parses and solves a netlist with parse temporaries from arena, reporting to
+    // progress; returns nullptr if
+    // the netlist is invalid, throws LoadCancelled if cancelled and any other
+    // exception if the netlist could not be solved. previous
+    // is the circuit the netlist is an edit of, nullptr for a new netlist
+    typedef function<circuitHandle(const string &path, circuitHandle previous, LoadArena &arena,
+                                   LoadProgress &progress)>
+        LoadFunction;
+
+    BackgroundLoader(LoadFunction load);
+
+    // cancels a running load
+    ~BackgroundLoader();
+
+    // start loading a netlist, cancelling any load still running; previous
+    // is the circuit to reload from if the netlist is an edit of it
+    void start(const string &path, circuitHandle previous = nullptr);
+
+    // a load was started and not yet collected with finish()
+    bool isLoading() const;
+
+    // the started load has completed, successfully or not
+    bool isFinished() const;
+
+    const LoadProgress &getProgress() const;
+    const string &getPath() const;
+
+    // ask the running load to stop at its next check
+    void cancel();
+
+    // wait for the load and return its circuit, nullptr if it was invalid,
+    // failed or cancelled
+    circuitHandle finish();
+
+    // why the last finished load failed, empty if it did not throw
+    const string &getError() const;
+
+private:
+    LoadFunction load;
+    LoadProgress progress;
+
+    // only the worker uses it, and there is one worker at a time
+    LoadArena arena;
+    string path;
+    thread worker;
+    atomic<bool> finished;
+    circuitHandle result;
+    string error;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "lu.h"
+
+#include <cmath>
+#include <utility>
+
+using namespace std;
+
+template <typename T>
+BasicLUFactorization<T>::BasicLUFactorization() : singular(false) {}
+
+template <typename T>
+BasicLUFactorization<T>::BasicLUFactorization(vector<vector<T>> matrix) : BasicLUFactorization(unfactored(move(matrix)))
+{
+    for (int k = 0; k < size(); k++)
+        factorColumn(k);
+}
+
+template <typename T>
+BasicLUFactorization<T> BasicLUFactorization<T>::unfactored(vector<vector<T>> matrix)
+{
+    BasicLUFactorization factors;
+    factors.lu = move(matrix);
+    factors.pivots.resize(factors.lu.size());
+    for (size_t i = 0; i < factors.pivots.size(); i++)
+        factors.pivots[i] = i;
+    return factors;
+}
+
+template <typename T>
+void BasicLUFactorization<T>::factorColumn(int k)
+{
+    int n = lu.size();
+
+    // pick the largest remaining entry in column k as the pivot
+    int pivot = k;
+    for (int i = k + 1; i < n; i++)
+    {
+        if (abs(lu[i][k]) > abs(lu[pivot][k]))
+            pivot = i;
+    }
+    if (pivot != k)
+    {
+        swap(lu[pivot], lu[k]);
+        swap(pivots[pivot], pivots[k]);
+    }
+
+    if (lu[k][k] == T(0))
+    {
+        singular = true;
+        return;
+    }
+
+    for (int i = k + 1; i < n; i++)
+    {
+        T factor = lu[i][k] / lu[k][k];
+        lu[i][k] = factor;
+        if (factor == T(0))
+            continue;
+        for (int j = k + 1; j < n; j++)
+            lu[i][j] -= factor * lu[k][j];
+    }
+}
+
+template <typename T>
+int BasicLUFactorization<T>::size() const
+{
+    return lu.size();
+}
+
+template <typename T>
+vector<T> BasicLUFactorization<T>::solve(const vector<T> &b) const
+{
+    int n = lu.size();
+    vector<T> x(n);
+
+    // forward substitution with L on the permuted right-hand side
+    for (int i = 0; i < n; i++)
+    {
+        T sum = b[pivots[i]];
+        for (int j = 0; j < i; j++)
+            sum -= lu[i][j] * x[j];
+        x[i] = sum;
+    }
+
+    // back substitution with U
+    for (int i = n - 1; i >= 0; i--)
+    {
+        T sum = x[i];
+        for (int j = i + 1; j < n; j++)
+            sum -= lu[i][j] * x[j];
+        x[i] = sum / lu[i][i];
+    }
+    return x;
+}
+
+template <typename T>
+vector<T> BasicLUFactorization<T>::solveTransposed(const vector<T> &b) const
+{
+    int n = lu.size();
+    vector<T> y(b);
+
+    // A^T = U^T L^T P, so solve U^T then L^T and undo the permutation.
+    // Both sweeps walk the rows of lu so the factors are read in storage order
+    for (int i = 0; i < n; i++)
+    {
+        y[i] /= lu[i][i];
+        for (int j = i + 1; j < n; j++)
+            y[j] -= lu[i][j] * y[i];
+    }
+    for (int i = n - 1; i >= 0; i--)
+    {
+        for (int j = 0; j < i; j++)
+            y[j] -= lu[i][j] * y[i];
+    }
+
+    vector<T> x(n);
+    for (int i = 0; i < n; i++)
+        x[pivots[i]] = y[i];
+    return x;
+}
+
+template struct BasicLUFactorization<double>;
+template struct BasicLUFactorization<complex<double>>;
+#ifdef CIRCUIT_ALL_TYPES
+template struct BasicLUFactorization<float>;
+template struct BasicLUFactorization<long double>;
+#endif
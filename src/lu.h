@@ -0,0 +1,49 @@
+#ifndef LU_H
+#define LU_H
+
+#include <complex>
+#include <vector>
+
+using namespace std;
+
+// LU factorization with partial pivoting of a dense square matrix, PA = LU.
+// Once factored, every new right-hand side costs one pair of triangular
+// solves instead of a full elimination. Instantiated for double and
+// complex<double> (AC analysis), and with CIRCUIT_ALL_TYPES for every value
+// type of the circuit core.
+template <typename T>
+struct BasicLUFactorization
+{
+    // L below the diagonal (unit diagonal implied) and U on and above it
+    vector<vector<T>> lu;
+
+    // row i of PA is row pivots[i] of A
+    vector<int> pivots;
+
+    // set if a zero pivot was met, solutions will then contain NaN or inf
+    bool singular;
+
+    BasicLUFactorization();
+    BasicLUFactorization(vector<vector<T>> matrix);
+
+    // matrix not yet factored, to be factored a column at a time with
+    // factorColumn(), e.g. to report progress or stop in between
+    static BasicLUFactorization unfactored(vector<vector<T>> matrix);
+
+    // pivot column k and eliminate below it; columns go in order from 0 to
+    // size() - 1, all before solving
+    void factorColumn(int k);
+
+    int size() const;
+
+    // solve A x = b
+    vector<T> solve(const vector<T> &b) const;
+
+    // solve A^T x = b
+    vector<T> solveTransposed(const vector<T> &b) const;
+};
+
+typedef BasicLUFactorization<double> LUFactorization;
+typedef BasicLUFactorization<complex<double>> ComplexLUFactorization;
+
+#endif
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <sys/stat.h>
 #include <vector>
 #include <cmath>
@@ -9,14 +10,33 @@
 #include <sstream>
 #include <string>
 #include <algorithm>
+#include <iterator>
+#include <map>
+#include <thread>
+#include <chrono>
 
+#include "arena.h"
 #include "circuit.h"
+#include "server.h"
+#include "cache.h"
+#include "loader.h"
+#include "resistance.h"
+#include "sensitivity.h"
+#include "transient.h"
+#include "ac.h"
+#include "export.h"
+#include "verify.h"
 
 using namespace std;
 
 // global variables
-Circuit currentCircuit;
+circuitHandle currentCircuit;
 string currentNetlist;
+string currentPath;
+CircuitCache *circuitCache;
+const OutOfCoreOptions *outOfCoreOptions;
+BackgroundLoader *loader;
+string loadingNetlist;
 
 // utility functions
 bool endsWithDotNet(const std::string &str)
@@ -33,16 +53,12 @@ bool fileExists(const std::string &path)
     return (stat(path.c_str(),&buffer)==0);
 }
 
-bool hasNan(const std::vector<double> &vec)
+// report how far a solution is from satisfying Kirchhoff's laws
+void printSolutionCheck(const SolutionCheck &check)
 {
-    for (const auto &val : vec)
-    {
-        if (std::isnan(val))
-        {
-            return true;
-        }
-    }
-    return false;
+    cout << "Residuals: " << check.maxCurrentResidual << " A at node " << check.worstNode << " ("
+         << check.relativeCurrentResidual << " relative), " << check.maxVoltageResidual << " V across source "
+         << check.worstSource + 1 << " (" << check.relativeVoltageResidual << " relative)" << endl;
 }
 
 bool isInExpectedFormat(const std::string& str) {
@@ -59,34 +75,177 @@ bool isInExpectedFormat(const std::string& str) {
             comma1 == ',' && comma2 == ',' && comma3 == ',');
 }
 
+// Validity of a netlist checked one line at a time as it streams past, keeping
+// only the subcircuit names and the instances still to be matched to them
+// rather than the lines themselves
+struct NetlistCheck
+{
+    std::map<std::string, int> subcircuits; // name and number of ports
+
+    // subcircuit name and number of nodes of each instance, checked at the
+    // end since instances may come before the definition
+    std::vector<std::pair<std::string, int>> instances;
+
+    bool inSubcircuit = false;
+
+    bool checkLine(std::string_view line);
+    bool finish() const;
+};
+
+bool NetlistCheck::checkLine(std::string_view line)
+{
+    if (line.empty())
+        return true; // Skip empty lines
+
+    if (line.compare(0, 7, ".subckt") == 0)
+    {
+        if (inSubcircuit)
+            return false; // Definitions can't be nested
+        inSubcircuit = true;
+
+        std::istringstream iss(std::string(line.substr(7)));
+        std::string name;
+        int port, numPorts = 0;
+        iss >> name;
+        while (iss >> port)
+        {
+            if (port <= 0)
+                return false; // Ports can't be ground
+            numPorts++;
+        }
+        if (name.empty() || numPorts == 0 || !iss.eof() || subcircuits.count(name))
+            return false; // Needs a new name and at least one port
+        subcircuits[name] = numPorts;
+        return true;
+    }
+    if (line.compare(0, 5, ".ends") == 0)
+    {
+        if (!inSubcircuit)
+            return false; // .ends without .subckt
+        inSubcircuit = false;
+        return true;
+    }
+
+    if (line[0] == 'X' && line.size() >= 2 && isdigit(line[1]))
+    {
+        std::istringstream iss{std::string(line)};
+        std::string label, name;
+        int node, numNodes = 0;
+        iss >> label >> name;
+        while (iss >> node)
+            numNodes++;
+        if (!iss.eof())
+            return false;
+        instances.push_back({name, numNodes});
+        return true;
+    }
+
+    if ((line[0] != 'V' && line[0] != 'R' && line[0] != 'C' && line[0] != 'L') ||
+        (line.size() < 2 || !isdigit(line[1])))
+    {
+        return false; // Line doesn't start with 'V', 'R', 'C', 'L' or 'X' followed by a digit
+    }
+
+    std::istringstream iss(std::string(line.substr(2))); // Skip the first two characters
+    double num1, num2, num3;
+    return bool(iss >> num1 >> num2 >> num3); // Line must match the format
+}
+
+bool NetlistCheck::finish() const
+{
+    for (const std::pair<std::string, int> &instance : instances)
+    {
+        auto subcircuit = subcircuits.find(instance.first);
+        if (subcircuit == subcircuits.end() || subcircuit->second != instance.second)
+            return false; // Unknown subcircuit or wrong number of nodes
+    }
+    return !inSubcircuit; // All lines match criteria
+}
+
+bool checkNetlistContents(std::string_view contents)
+{
+    NetlistCheck check;
+    for (size_t start = 0; start < contents.size();)
+    {
+        size_t end = std::min(contents.find('\n', start), contents.size());
+        if (!check.checkLine(contents.substr(start, end - start)))
+            return false;
+        start = end + 1;
+    }
+    return check.finish();
+}
+
 bool checkNetlistValidity(const std::string &filename){
     std::ifstream file(filename);
     if (!file.is_open())
     {
         return false; // Unable to open file
     }
-
+    NetlistCheck check;
     std::string line;
     while (getline(file, line))
     {
-        if (line.empty())
-            continue; // Skip empty lines
+        if (!check.checkLine(line))
+            return false;
+    }
+    return check.finish();
+}
 
-        if ((line[0] != 'V' && line[0] != 'R') ||
-            (line.size() < 2 || !isdigit(line[1])))
-        {
-            return false; // Line doesn't start with 'V' or 'R' followed by a digit
-        }
+std::string readFile(const std::string &path)
+{
+    std::ifstream file(path);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
 
-        std::istringstream iss(line.substr(2)); // Skip the first two characters
-        double num1, num2, num3;
-        if (!(iss >> num1 >> num2 >> num3))
+// load a netlist through the cache, only parsing and solving netlists whose
+// contents have not been seen before, with parse temporaries from arena
+// (released before returning). Returns nullptr if the netlist is invalid
+// and throws if it cannot be solved, e.g. when a subcircuit instantiates itself.
+// With progress given, reports to it and throws LoadCancelled if cancelled.
+// With previous given, the netlist is an edit of it and is solved reusing
+// its factorization where the edit allows
+circuitHandle loadCircuit(const std::string &path, LoadArena &loadArena, LoadProgress *progress = nullptr,
+                          circuitHandle previous = nullptr)
+{
+    std::string contents = readFile(path);
+    circuitHandle circuit = circuitCache->find(contents);
+    if (circuit != nullptr)
+        return circuit;
+
+    // validated and parsed in place, the contents are never copied
+    if (!checkNetlistContents(contents))
+        return nullptr;
+
+    try
+    {
+        std::shared_ptr<Circuit> loaded =
+            previous != nullptr
+                ? std::make_shared<Circuit>(*previous, std::string_view(contents), loadArena.resource(), progress,
+                                            outOfCoreOptions)
+                : std::make_shared<Circuit>(std::string_view(contents), loadArena.resource(), progress,
+                                            outOfCoreOptions);
+        loadArena.release();
+
+        // a failed solve (NaN or inf) is returned for the caller to report
+        // but never cached. An inaccurate solution, e.g. from a reload that
+        // corrected old factors, is refined with the factors before it is
+        // cached. Out of core solves keep no factors to refine with
+        SolutionCheck check(*loaded);
+        if (!check.isFinite())
+            return loaded;
+        if (!loaded->isOutOfCore() && !check.passed())
         {
-            return false; // Line doesn't match the format
+            loaded->refineSolution();
+            if (!SolutionCheck(*loaded).isFinite())
+                return loaded;
         }
+        return circuitCache->insert(contents, loaded);
+    }
+    catch (...)
+    {
+        loadArena.release();
+        throw;
     }
-
-    return true; // All lines match criteria
 }
 
 bool isInteger(const std::string &s) {
@@ -145,12 +304,33 @@ void readNewNetlist()
          << endl;
 
     cout << "A. Read netlist from relative path in input/" << endl;
-    cout << "B. Read netlist from absolute path" << endl
+    cout << "B. Read netlist from absolute path" << endl;
+    cout << "C. Reload the current netlist after editing it" << endl
          << endl;
 
     char option;
     cin >> option;
-    
+
+    if (option == 'C')
+    {
+        if (currentPath.empty())
+        {
+            cout << "\nError: no netlist loaded" << endl;
+            return;
+        }
+        if (!fileExists(currentPath))
+        {
+            cout << "\nError: " << currentPath << " not found" << endl;
+            return;
+        }
+
+        // only the components that changed are solved for again
+        loader->start(currentPath, currentCircuit);
+        loadingNetlist = currentNetlist;
+        cout << "\nReloading " << currentNetlist << " in the background" << endl;
+        return;
+    }
+
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     cout << "\nEnter netlist file path: ";
     string netlist;
@@ -163,63 +343,159 @@ void readNewNetlist()
         return;
     }
 
-    Circuit c;
+    string path;
     switch (option)
     {
     case 'A':
     {
-        if (!fileExists("../input/" + netlist))
+        path = "../input/" + netlist;
+        if (!fileExists(path))
         {
             cout << "\nError: "
                  << "input/" + netlist << " not found" << endl;
             return;
         }
-        else if (!checkNetlistValidity("../input/" + netlist))
-        {
-            cout << "\nError: Netlist file invalid" << endl;
-            return;
-        }
-        c = Circuit("../input/" + netlist);
         break;
     }
     case 'B':
     {
-        if (!fileExists(netlist))
+        path = netlist;
+        if (!fileExists(path))
         {
             cout << "\nError: " << netlist << " not found" << endl;
             return;
         }
-        else if (!checkNetlistValidity(netlist))
-        {
-            cout << "\nError: Netlist file invalid" << endl;
-            return;
-        }
-        c = Circuit(netlist);
         break;
     }
+    default:
+        return;
+    }
+
+    // parsed and solved in the background, the current netlist stays usable
+    loader->start(path);
+    loadingNetlist = netlist;
+    cout << "\nLoading " << netlist << " in the background" << endl;
+}
+
+const char *getPhaseName(LoadProgress::Phase phase)
+{
+    switch (phase)
+    {
+    case LoadProgress::PARSING:
+        return "parsing";
+    case LoadProgress::ASSEMBLING:
+        return "assembling";
+    case LoadProgress::SOLVING:
+        return "solving";
+    default:
+        return "done";
+    }
+}
+
+// swap in the netlist loaded in the background, waiting for it if needed
+void collectLoadedCircuit()
+{
+    circuitHandle c = loader->finish();
+    if (loader->getProgress().cancelled)
+    {
+        cout << "\nLoading " << loadingNetlist << " cancelled" << endl;
+        return;
+    }
+    if (!loader->getError().empty())
+    {
+        cout << "\nError: " << loader->getError() << endl;
+        return;
+    }
+    if (c == nullptr)
+    {
+        cout << "\nError: Netlist file invalid" << endl;
+        return;
     }
 
     // if netlist valid
-    // check if circuit is valid (NaN does not appear)
-    if (hasNan(c.sourceCurrents) || hasNan(c.nodeVoltages) || hasNan(c.resistorCurrents))
+    // check if circuit is valid (NaN does not appear and Kirchhoff's laws hold)
+    SolutionCheck check(*c);
+    if (!check.isFinite())
     {
         cout << "Error: netlist is invalid" << endl;
     }
+    else if (!check.passed())
+    {
+        cout << "Warning: solution is inaccurate" << endl;
+    }
 
-    // if circuit invalid (NaN appears in computations), print error message and halt
-
-    // if circuit valid
     // set currentNetlist file
-    currentCircuit = c;
-    currentNetlist = netlist;
+    currentCircuit = std::move(c);
+    currentNetlist = loadingNetlist;
+    currentPath = loader->getPath();
+    cout << "\nLoaded " << currentNetlist;
+    if (currentCircuit->getSolveMethod() == Circuit::SAME_MATRIX)
+        cout << " (only sources changed, factorization reused)";
+    else if (currentCircuit->getSolveMethod() == Circuit::LOW_RANK_UPDATE)
+        cout << " (" << currentCircuit->getConductanceUpdateCount() << " conductance changes on a reused factorization)";
+    else if (currentCircuit->getSolveMethod() == Circuit::REFINED_SOLVE)
+        cout << " (solved again with iterative refinement)";
+    cout << endl;
+    printSolutionCheck(check);
 }
 
-void computeCurrent() {
-    vector<double> currents = currentCircuit.getCurrentVector();
+// show the progress of the background load until it completes
+void waitForLoad()
+{
+    if (!loader->isLoading())
+    {
+        cout << "\nNo netlist is being loaded" << endl;
+        return;
+    }
+
+    while (!loader->isFinished())
+    {
+        const LoadProgress &progress = loader->getProgress();
+        cout << "\r" << loadingNetlist << ": " << getPhaseName(progress.phase) << " "
+             << progress.percent << "%   " << flush;
+        this_thread::sleep_for(chrono::milliseconds(200));
+    }
+    cout << endl;
+    collectLoadedCircuit();
+}
 
+void cancelLoad()
+{
+    if (!loader->isLoading())
+    {
+        cout << "\nNo netlist is being loaded" << endl;
+        return;
+    }
+    loader->cancel();
+    collectLoadedCircuit();
+}
+
+// transient, AC, sensitivities and effective resistance work on the conductance matrix,
+// which is not kept for a circuit solved out of core
+bool hasConductanceMatrix()
+{
+    if (!currentCircuit->isOutOfCore())
+        return true;
+    cout << "\nError: " << currentNetlist << " was solved out of core and its matrix was not kept" << endl;
+    return false;
+}
+
+// subcircuits are reduced to port models at DC, losing their capacitors and
+// inductors, so transient and AC analysis need a circuit without them
+bool hasNoSubcircuits()
+{
+    if (currentCircuit->subcircuits.empty())
+        return true;
+    cout << "\nError: " << currentNetlist << " has subcircuits, which are only reduced for DC" << endl;
+    return false;
+}
+
+void computeCurrent() {
     cout << "\nSelect one of the following options:\n\n";
     cout << "A. Compute currents across all branches in circuit\n";
-    cout << "B. Compute currents across a net list\n\n";
+    cout << "B. Compute currents across a net list\n";
+    cout << "C. Compute effective resistance and short-circuit current between a pair of nodes written like [1,2]\n";
+    cout << "D. Estimate the effective resistance from one node to every node\n\n";
 
 
     cin.ignore(numeric_limits<streamsize>::max(), '\n');
@@ -230,10 +506,76 @@ void computeCurrent() {
     switch (option) {
     case 'A':
         // Assuming currentCircuit.currents is a std::map or similar associative container
-        for (const auto& current : currentCircuit.currents) {
-            cout << "I(" << current.first << "): " << current.second << endl;
+        // '\n' rather than endl so a long list is not flushed line by line
+        for (const auto& current : currentCircuit->getCurrents()) {
+            cout << "I(" << current.first << "): " << current.second << '\n';
+        }
+        cout << flush;
+        break;
+    case 'C':
+    {
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        cout << "Please enter net names in expected format [1,2]: ";
+
+        string input;
+        getline(cin, input);
+
+        int node1, node2;
+        if (!isValidFormat(input) || !extractNumbers(input, node1, node2))
+        {
+            cout << "\nError: Invalid net name format" << endl;
+            return;
         }
+        if (node1 < 0 || node2 < 0 ||
+            node1 >= (int)currentCircuit->nodeVoltages.size() ||
+            node2 >= (int)currentCircuit->nodeVoltages.size())
+        {
+            cout << "\nError: Nodes not in netlist" << endl;
+            return;
+        }
+        if (!hasConductanceMatrix())
+            return;
+        cout << "\nEffective resistance: " << currentCircuit->getEffectiveResistance(node1, node2) << endl;
+        cout << "Short-circuit current: " << currentCircuit->getShortCircuitCurrent(node1, node2) << endl;
         break;
+    }
+    case 'D':
+    {
+        if (!hasConductanceMatrix())
+            return;
+        int node;
+        double epsilon;
+        cout << "Node: ";
+        cin >> node;
+        cout << "Relative error, e.g. 0.1: ";
+        cin >> epsilon;
+        if (!cin || epsilon <= 0 || epsilon >= 1)
+        {
+            cin.clear();
+            cout << "\nError: Invalid relative error" << endl;
+            return;
+        }
+        if (node < 0 || node >= (int)currentCircuit->nodeVoltages.size())
+        {
+            cout << "\nError: Nodes not in netlist" << endl;
+            return;
+        }
+
+        try
+        {
+            ResistanceSketch sketch(*currentCircuit, epsilon);
+            vector<double> resistances = sketch.getResistancesFrom(node);
+            cout << "\nEstimated from " << sketch.dimension << " solves:" << '\n';
+            for (size_t other = 0; other < resistances.size(); other++)
+                cout << "R(" << node << "," << other << "): " << resistances[other] << '\n';
+            cout << flush;
+        }
+        catch (const invalid_argument &e)
+        {
+            cout << "\nError: " << e.what() << endl;
+        }
+        break;
+    }
     case 'B':
         cin.ignore(numeric_limits<streamsize>::max(), '\n');
         cout << "Please enter net name or list of net names expected format [1,2] or [1,2],[2,0]: ";
@@ -286,7 +628,7 @@ void computeCurrent() {
             // ss.ignore(1, ',');
         }
 
-        double totalCurrent = currentCircuit.getCurrentFromPoints(nodePairs);
+        double totalCurrent = currentCircuit->getCurrentFromPoints(nodePairs);
         cout << "Total current: " << totalCurrent << endl;
         break;
     }
@@ -300,7 +642,8 @@ void computeVoltage()
     cout << "A. Compute voltages of all nodes in circuit" << endl;
     cout << "B. Compute voltage at a single node" << endl;
     cout << "C. Compute voltage at each node in a list of nodes written like [2,3,5]" << endl;
-    cout << "D. Compute voltage drop between a pair of connected nodes written like [1,2]" << endl << endl;
+    cout << "D. Compute voltage drop between a pair of connected nodes written like [1,2]" << endl;
+    cout << "E. Compute sensitivity of the voltage at a single node to every component" << endl << endl;
 
     cin.ignore(numeric_limits<streamsize>::max(), '\n');
     char option;
@@ -311,10 +654,11 @@ void computeVoltage()
     {
         case 'A': 
         {
-            for (int i = 0; i < currentCircuit.nodeVoltages.size(); i++)
+            for (int i = 0; i < currentCircuit->nodeVoltages.size(); i++)
             {
-                cout << "V(" << i << "): " << currentCircuit.nodeVoltages[i] << endl;
+                cout << "V(" << i << "): " << currentCircuit->nodeVoltages[i] << '\n';
             }
+            cout << flush;
             break;
         }
         case 'B': 
@@ -324,12 +668,12 @@ void computeVoltage()
             int node;
             cin >> node;
             cout << endl;
-            if (node < 0 || node >= currentCircuit.nodeVoltages.size())
+            if (node < 0 || node >= currentCircuit->nodeVoltages.size())
             {
                 cout << "Error: Node does not exist in current netlist" << endl;
                 return;
             }
-            cout << "V(" << node << "): " << currentCircuit.nodeVoltages[node] << endl;
+            cout << "V(" << node << "): " << currentCircuit->nodeVoltages[node] << endl;
             break;
         }
         case 'C':
@@ -356,17 +700,16 @@ void computeVoltage()
             }
             for (auto node : nodes)
             {
-                if (node < 0 || node >= currentCircuit.nodeVoltages.size())
+                if (node < 0 || node >= currentCircuit->nodeVoltages.size())
                 {
                     cout << "Error: Node does not exist in current netlist" << endl;
                     return;
                 }
             }
 
-            for (int node : nodes){
-                auto it = currentCircuit.voltages.begin();
-                advance(it, node);
-                cout<<"V("<<node<<"): "<<it->second<<endl;
+            vector<double> values = currentCircuit->getNodeVoltages(nodes);
+            for (size_t i = 0; i < nodes.size(); i++){
+                cout<<"V("<<nodes[i]<<"): "<<values[i]<<endl;
             }
             break;
         }
@@ -385,26 +728,186 @@ void computeVoltage()
             }
             int node1, node2;
             extractNumbers(input, node1, node2);
-            if (node1 > currentCircuit.branchIncidenceMatrix.size() ||
-                node2 > currentCircuit.branchIncidenceMatrix.size() ||
+            if (node1 >= currentCircuit->getNodeCount() ||
+                node2 >= currentCircuit->getNodeCount() ||
                 node1 < 0 || node2 < 0)
             {
                 cout << "\nError: Nodes not in netlist" << endl;
                 return;
             }
             cout << "\nVoltage drop from nodes " << node1 << " and " << node2 << ": " 
-                 << currentCircuit.getVoltageFromPoints(node1, node2) << endl;
+                 << currentCircuit->getVoltageFromPoints(node1, node2) << endl;
+            break;
+        }
+        case 'E':
+        {
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            if (!hasConductanceMatrix())
+                return;
+            cout << "What node would you like the sensitivities for? ";
+            int node;
+            cin >> node;
+            cout << endl;
+            if (node < 0 || node >= (int)currentCircuit->nodeVoltages.size())
+            {
+                cout << "Error: Node does not exist in current netlist" << endl;
+                return;
+            }
 
+            try
+            {
+                Sensitivity sensitivity(*currentCircuit, {SensitivityOutput::NODE_VOLTAGE, node, 0});
+                for (unsigned int i = 0; i < sensitivity.batteries.size(); i++)
+                    cout << "dV(" << node << ")/dV" << i + 1 << ": " << sensitivity.batteries[i] << endl;
+                for (unsigned int i = 0; i < sensitivity.resistors.size(); i++)
+                    cout << "dV(" << node << ")/dR" << i + 1 << ": " << sensitivity.resistors[i] << endl;
+            }
+            catch (const invalid_argument &e)
+            {
+                cout << "Error: " << e.what() << endl;
+            }
+            break;
         }
     }
 }
 
+void runTransient()
+{
+    if (!hasConductanceMatrix() || !hasNoSubcircuits())
+        return;
+    TransientOptions options;
+
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cout << "\nStop time (s): ";
+    cin >> options.stopTime;
+    cout << "Time step (s): ";
+    cin >> options.timeStep;
+    cout << "Error tolerance for adaptive steps, 0 for fixed steps: ";
+    cin >> options.tolerance;
+    if (!cin || options.stopTime <= 0 || options.timeStep <= 0 || options.tolerance < 0)
+    {
+        cin.clear();
+        cout << "\nError: Invalid transient settings" << endl;
+        return;
+    }
+    options.maxTimeStep = options.stopTime / 10;
+
+    cout << "\nSelect one of the following integration methods:" << endl
+         << endl;
+    cout << "A. Backward Euler" << endl;
+    cout << "B. Trapezoidal" << endl
+         << endl;
+    char option;
+    cin >> option;
+    options.method = option == 'B' ? TRAPEZOIDAL : BACKWARD_EULER;
+
+    cout << "\nSelect the state at t = 0:" << endl
+         << endl;
+    cout << "A. DC operating point" << endl;
+    cout << "B. De-energized, sources switching on at t = 0" << endl
+         << endl;
+    cin >> option;
+    options.fromOperatingPoint = option != 'B';
+
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cout << "\nEnter output CSV file path: ";
+    string path;
+    getline(cin, path);
+    ofstream out(path);
+    if (!out.is_open())
+    {
+        cout << "\nError: could not open " << path << endl;
+        return;
+    }
+
+    TransientAnalysis analysis(*currentCircuit);
+    analysis.run(options, out);
+    cout << "\nWaveforms written to " << path << " (" << analysis.getFactorizationCount()
+         << " matrix factorizations)" << endl;
+}
+
+void runAcSweep()
+{
+    if (!hasConductanceMatrix() || !hasNoSubcircuits())
+        return;
+    double start, stop;
+    int numPoints, source;
+
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cout << "\nStart frequency (Hz): ";
+    cin >> start;
+    cout << "Stop frequency (Hz): ";
+    cin >> stop;
+    cout << "Number of frequency points: ";
+    cin >> numPoints;
+    cout << "Input voltage source number (1 for V1): ";
+    cin >> source;
+    if (!cin || start <= 0 || stop < start || numPoints < 1 ||
+        source < 1 || source > (int)currentCircuit->batteries.size())
+    {
+        cin.clear();
+        cout << "\nError: Invalid sweep settings" << endl;
+        return;
+    }
+
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cout << "\nEnter output file path: ";
+    string path;
+    getline(cin, path);
+    ofstream out(path, ios::binary);
+    if (!out.is_open())
+    {
+        cout << "\nError: could not open " << path << endl;
+        return;
+    }
+
+    AcSweep sweep(*currentCircuit, source - 1, AcSweep::logarithmicFrequencies(start, stop, numPoints));
+    sweep.write(out);
+    cout << "\nSweep of " << numPoints << " points written to " << path << endl;
+}
+
+void exportCircuitResults()
+{
+    cout << "\nSelect one of the following formats:" << endl
+         << endl;
+    cout << "A. CSV" << endl;
+    cout << "B. Binary columnar" << endl
+         << endl;
+
+    char option;
+    cin >> option;
+    if (option != 'A' && option != 'B')
+        return;
+
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cout << "\nEnter output file path: ";
+    string path;
+    getline(cin, path);
+
+    try
+    {
+        exportResults(*currentCircuit, path, option == 'A' ? EXPORT_CSV : EXPORT_BINARY);
+    }
+    catch (const std::exception &e)
+    {
+        cout << "\nError: " << e.what() << endl;
+        return;
+    }
+    cout << "\nResults written to " << path << endl;
+}
+
 void displayMenu()
 {
     cout << "\n=====================================================\n\n";
 
-    cout << "Current netlist: " << currentNetlist << endl
-         << endl;
+    cout << "Current netlist: " << currentNetlist << endl;
+    if (loader->isLoading())
+    {
+        const LoadProgress &progress = loader->getProgress();
+        cout << "Loading: " << loadingNetlist << " (" << getPhaseName(progress.phase) << " "
+             << progress.percent << "%)" << endl;
+    }
+    cout << endl;
 
     cout << "Select one of the following options:" << endl
          << endl;
@@ -412,24 +915,135 @@ void displayMenu()
     cout << "A. Read a new netlist" << endl;
     cout << "B. Compute current values for the current netlist" << endl;
     cout << "C. Compute voltage values for the current netlist" << endl;
-    cout << "D. Exit" << endl << endl;
+    cout << "D. Exit" << endl;
+    cout << "E. Run a transient analysis of the current netlist" << endl;
+    cout << "F. Run an AC frequency sweep of the current netlist" << endl;
+    cout << "G. Wait for the netlist being loaded" << endl;
+    cout << "H. Cancel loading the netlist" << endl;
+    cout << "I. Export all voltages and currents of the current netlist to a file" << endl << endl;
     // currentCircuit.printBatteries();
     // currentCircuit.printResistors();
     // currentCircuit.printBranchIncidenceMatrix();
     
 }
 
-int main()
+// load every netlist given on the command line and answer queries over a
+// Unix domain socket until a client sends SHUTDOWN
+int serve(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        cout << "Usage: " << argv[0] << " --serve <socket path> [--threads <n>] <netlist> ..." << endl;
+        return 1;
+    }
+
+    string socketPath = argv[2];
+    unsigned int numThreads = thread::hardware_concurrency();
+    int first = 3;
+    if (string(argv[3]) == "--threads" && argc > 4)
+    {
+        numThreads = stoul(argv[4]);
+        first = 5;
+    }
+
+    // the netlists are loaded one after another on this thread
+    LoadArena loadArena;
+    circuitList circuits;
+    for (int i = first; i < argc; i++)
+    {
+        string netlist = argv[i];
+        circuitHandle c;
+        try
+        {
+            if (endsWithDotNet(netlist) && fileExists(netlist))
+                c = loadCircuit(netlist, loadArena);
+        }
+        catch (const exception &e)
+        {
+            cout << "Error: " << e.what() << ": " << netlist << endl;
+            return 1;
+        }
+        if (c == nullptr)
+        {
+            cout << "Error: Netlist file invalid: " << netlist << endl;
+            return 1;
+        }
+
+        SolutionCheck check(*c);
+        if (!check.isFinite())
+        {
+            cout << "Error: netlist is invalid: " << netlist << endl;
+            return 1;
+        }
+        if (!check.passed())
+        {
+            cout << "Warning: solution is inaccurate: " << netlist << endl;
+            printSolutionCheck(check);
+        }
+        circuits.push_back({netlist, c});
+    }
+
+    return runServer(socketPath, circuits, numThreads);
+}
+
+int main(int argc, char *argv[])
 {
+    // solved circuits are cached by netlist contents, optionally on disk, and
+    // matrices over the out-of-core budget are factored in a scratch file
+    size_t cacheMegabytes = 256;
+    string cacheDirectory;
+    OutOfCoreOptions outOfCore;
+    size_t outOfCoreMegabytes = 1024;
+    bool useOutOfCore = false;
+    int first = 1;
+    while (first + 1 < argc && (string(argv[first]) == "--cache-mb" || string(argv[first]) == "--cache-dir" ||
+                                string(argv[first]) == "--ooc-dir" || string(argv[first]) == "--ooc-mb"))
+    {
+        if (string(argv[first]) == "--cache-mb")
+            cacheMegabytes = stoul(argv[first + 1]);
+        else if (string(argv[first]) == "--cache-dir")
+            cacheDirectory = argv[first + 1];
+        else if (string(argv[first]) == "--ooc-dir")
+        {
+            outOfCore.directory = argv[first + 1];
+            useOutOfCore = true;
+        }
+        else
+        {
+            outOfCoreMegabytes = stoul(argv[first + 1]);
+            useOutOfCore = true;
+        }
+        first += 2;
+    }
+    CircuitCache cache(cacheMegabytes << 20, cacheDirectory);
+    circuitCache = &cache;
+    outOfCore.memoryBudget = outOfCoreMegabytes << 20;
+    outOfCoreOptions = useOutOfCore ? &outOfCore : nullptr;
+
+    if (argc > first && string(argv[first]) == "--serve")
+        return serve(argc - first + 1, argv + first - 1);
+
+    currentCircuit = make_shared<const Circuit>();
     currentNetlist = "no netlist selected";
 
+    BackgroundLoader backgroundLoader(
+        [](const string &path, circuitHandle previous, LoadArena &arena, LoadProgress &progress) {
+            return loadCircuit(path, arena, &progress, previous);
+        });
+    loader = &backgroundLoader;
+
     char option;
     bool stop = false;
     while (!stop)
     {
+        if (loader->isFinished())
+            collectLoadedCircuit();
         displayMenu();
 
-        cin >> option;
+        if (!(cin >> option))
+            break;
+        if (loader->isFinished())
+            collectLoadedCircuit();
         switch (option)
         {
         case 'A':
@@ -452,6 +1066,31 @@ int main()
             stop = true;
             break;
         }
+        case 'E':
+        {
+            runTransient();
+            break;
+        }
+        case 'F':
+        {
+            runAcSweep();
+            break;
+        }
+        case 'G':
+        {
+            waitForLoad();
+            break;
+        }
+        case 'H':
+        {
+            cancelLoad();
+            break;
+        }
+        case 'I':
+        {
+            exportCircuitResults();
+            break;
+        }
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,245 @@
+#include "mapped.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+template <typename T>
+BasicMappedLUFactorization<T>::BasicMappedLUFactorization(const string &directory, size_t n, size_t memoryBudget)
+    : singular(false), n(n), data(nullptr), mappedBytes(max<size_t>(n * n * sizeof(T), 1)), pivots(n)
+{
+    // the current panel and the earlier one streamed past it
+    panelWidth = memoryBudget / (2 * max<size_t>(n, 1) * sizeof(T));
+    panelWidth = min(max<size_t>(panelWidth, 1), max<size_t>(n, 1));
+
+    string path = (directory.empty() ? string(".") : directory) + "/circuit-factors-XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd < 0)
+        throw runtime_error("could not create a scratch file in " + directory + ": " + strerror(errno));
+
+    // a new file reads as zeros, and is removed once it is unmapped
+    unlink(path.c_str());
+    if (ftruncate(fd, mappedBytes) != 0)
+    {
+        string error = strerror(errno);
+        close(fd);
+        throw runtime_error("could not size the scratch file " + path + ": " + error);
+    }
+    void *mapping = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    string error = strerror(errno);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        throw runtime_error("could not map the scratch file " + path + ": " + error);
+    data = (T *)mapping;
+}
+
+template <typename T>
+BasicMappedLUFactorization<T>::~BasicMappedLUFactorization()
+{
+    munmap(data, mappedBytes);
+}
+
+template <typename T>
+typename BasicMappedLUFactorization<T>::Row BasicMappedLUFactorization<T>::operator[](size_t i)
+{
+    return {data + i, n};
+}
+
+template <typename T>
+size_t BasicMappedLUFactorization<T>::size() const
+{
+    return n;
+}
+
+template <typename T>
+size_t BasicMappedLUFactorization<T>::getPanelWidth() const
+{
+    return panelWidth;
+}
+
+template <typename T>
+size_t BasicMappedLUFactorization<T>::getPanelCount() const
+{
+    return (n + panelWidth - 1) / panelWidth;
+}
+
+template <typename T>
+T *BasicMappedLUFactorization<T>::column(size_t j) const
+{
+    return data + j * n;
+}
+
+// byte range of the pages holding a panel
+template <typename T>
+void BasicMappedLUFactorization<T>::pageRange(size_t panel, size_t &start, size_t &end) const
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t first = panel * panelWidth;
+    size_t last = min(n, first + panelWidth);
+    start = first * n * sizeof(T) / page * page;
+    end = min(mappedBytes, (last * n * sizeof(T) + page - 1) / page * page);
+}
+
+template <typename T>
+void BasicMappedLUFactorization<T>::advise(size_t panel, int advice) const
+{
+    size_t start, end;
+    pageRange(panel, start, end);
+    if (end > start)
+        madvise((char *)data + start, end - start, advice);
+}
+
+template <typename T>
+void BasicMappedLUFactorization<T>::factorPanel(size_t panel)
+{
+    size_t c0 = panel * panelWidth;
+    size_t c1 = min(n, c0 + panelWidth);
+    // each earlier panel prefetches the one after it, the first is fetched here
+    advise(panel, MADV_WILLNEED);
+    if (panel > 0)
+        advise(0, MADV_WILLNEED);
+
+    // bring the panel up to date with every earlier one, in order
+    for (size_t k = 0; k < panel; k++)
+    {
+        if (k + 1 < panel)
+            advise(k + 1, MADV_WILLNEED);
+
+        size_t p0 = k * panelWidth;
+        size_t p1 = p0 + panelWidth;
+        for (size_t j = p0; j < p1; j++)
+        {
+            if (pivots[j] == j)
+                continue;
+            for (size_t c = c0; c < c1; c++)
+                swap(column(c)[j], column(c)[pivots[j]]);
+        }
+
+        // U of the rows of panel k, and the rows below updated with it
+        for (size_t c = c0; c < c1; c++)
+        {
+            T *target = column(c);
+            for (size_t j = p0; j < p1; j++)
+            {
+                T x = target[j];
+                if (x == T(0))
+                    continue;
+                const T *L = column(j);
+                for (size_t i = j + 1; i < n; i++)
+                    target[i] -= L[i] * x;
+            }
+        }
+
+        // panel k is read again only for the next panel, from disk
+        advise(k, MADV_DONTNEED);
+    }
+
+    // factor the panel itself, swapping whole panel rows
+    for (size_t j = c0; j < c1; j++)
+    {
+        T *pivotColumn = column(j);
+        size_t pivot = j;
+        for (size_t i = j + 1; i < n; i++)
+        {
+            if (abs(pivotColumn[i]) > abs(pivotColumn[pivot]))
+                pivot = i;
+        }
+        pivots[j] = pivot;
+        if (pivot != j)
+        {
+            for (size_t c = c0; c < c1; c++)
+                swap(column(c)[j], column(c)[pivot]);
+        }
+
+        if (pivotColumn[j] == T(0))
+        {
+            singular = true;
+            continue;
+        }
+
+        for (size_t i = j + 1; i < n; i++)
+            pivotColumn[i] /= pivotColumn[j];
+        for (size_t c = j + 1; c < c1; c++)
+        {
+            T *target = column(c);
+            T x = target[j];
+            if (x == T(0))
+                continue;
+            for (size_t i = j + 1; i < n; i++)
+                target[i] -= pivotColumn[i] * x;
+        }
+    }
+
+    // start writing the finished panel back and let its pages go
+    size_t start, end;
+    pageRange(panel, start, end);
+    if (end > start)
+        msync((char *)data + start, end - start, MS_ASYNC);
+    advise(panel, MADV_DONTNEED);
+}
+
+// The L of each panel keeps the row order it was factored in, since later
+// swaps only reach the panels factored after them. The right-hand side is
+// swapped panel by panel on the way down, so it always matches.
+template <typename T>
+vector<T> BasicMappedLUFactorization<T>::solve(const vector<T> &b) const
+{
+    vector<T> x(b);
+    size_t panels = getPanelCount();
+
+    // forward substitution with L
+    for (size_t k = 0; k < panels; k++)
+    {
+        if (k + 1 < panels)
+            advise(k + 1, MADV_WILLNEED);
+
+        size_t p0 = k * panelWidth;
+        size_t p1 = min(n, p0 + panelWidth);
+        for (size_t j = p0; j < p1; j++)
+            swap(x[j], x[pivots[j]]);
+        for (size_t j = p0; j < p1; j++)
+        {
+            if (x[j] == T(0))
+                continue;
+            const T *L = column(j);
+            for (size_t i = j + 1; i < n; i++)
+                x[i] -= L[i] * x[j];
+        }
+        advise(k, MADV_DONTNEED);
+    }
+
+    // back substitution with U, column by column from the last
+    for (size_t k = panels; k-- > 0;)
+    {
+        if (k > 0)
+            advise(k - 1, MADV_WILLNEED);
+
+        size_t p0 = k * panelWidth;
+        size_t p1 = min(n, p0 + panelWidth);
+        for (size_t j = p1; j-- > p0;)
+        {
+            const T *U = column(j);
+            x[j] /= U[j];
+            for (size_t i = 0; i < j; i++)
+                x[i] -= U[i] * x[j];
+        }
+        advise(k, MADV_DONTNEED);
+    }
+    return x;
+}
+
+template class BasicMappedLUFactorization<double>;
+#ifdef CIRCUIT_ALL_TYPES
+template class BasicMappedLUFactorization<float>;
+template class BasicMappedLUFactorization<long double>;
+template class BasicMappedLUFactorization<complex<double>>;
+#endif
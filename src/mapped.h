@@ -0,0 +1,72 @@
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include <complex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// LU factorization with partial pivoting of a dense square matrix kept in a
+// memory-mapped scratch file instead of RAM, for systems whose factors do not
+// fit in memory. The matrix is stored column by column and factored one panel
+// of columns at a time (left-looking): every earlier panel is streamed past
+// the current one to update it, then the panel is factored and handed back to
+// the operating system. The panel width is chosen so the current panel and the
+// one being streamed fit in the memory budget, and the next panel to be read
+// is prefetched while the current one is in use. Instantiated for double,
+// and with CIRCUIT_ALL_TYPES for every value type of the circuit core.
+template <typename T>
+class BasicMappedLUFactorization
+{
+public:
+    // one row of the matrix during assembly, matrix[i][j]
+    struct Row
+    {
+        T *first; // entry in column 0
+        size_t stride;
+
+        T &operator[](size_t j) const { return first[j * stride]; }
+    };
+
+    // an n x n zero matrix in a scratch file created in directory; the file
+    // is removed when the factorization is destroyed. Throws runtime_error if
+    // the file cannot be created or mapped
+    BasicMappedLUFactorization(const string &directory, size_t n, size_t memoryBudget);
+    ~BasicMappedLUFactorization();
+
+    BasicMappedLUFactorization(const BasicMappedLUFactorization &) = delete;
+    BasicMappedLUFactorization &operator=(const BasicMappedLUFactorization &) = delete;
+
+    Row operator[](size_t i);
+
+    size_t size() const;
+    size_t getPanelWidth() const;
+    size_t getPanelCount() const;
+
+    // factor panels in order, 0 to getPanelCount() - 1, before solving
+    void factorPanel(size_t panel);
+
+    // solve A x = b once every panel is factored
+    vector<T> solve(const vector<T> &b) const;
+
+    // set if a zero pivot was met, solutions will then contain NaN or inf
+    bool singular;
+
+private:
+    size_t n;
+    size_t panelWidth;
+    T *data;
+    size_t mappedBytes;
+
+    // row swapped with row j when column j was factored
+    vector<size_t> pivots;
+
+    T *column(size_t j) const;
+    void pageRange(size_t panel, size_t &start, size_t &end) const;
+    void advise(size_t panel, int advice) const;
+};
+
+typedef BasicMappedLUFactorization<double> MappedLUFactorization;
+
+#endif
@@ -0,0 +1,235 @@
+#include "port.h"
+
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+
+#include "lu.h"
+
+using namespace std;
+
+template <typename Scalar, typename Index>
+BasicPortModel<Scalar, Index>::BasicPortModel() {}
+
+// With the system split into port rows p and the rest q,
+//     [Gpp Gpq] [v ]   [bp + i]
+//     [Gqp Gqq] [xq] = [bq    ]
+// eliminating xq gives (Gpp - Gpq Gqq^-1 Gqp) v = bp - Gpq Gqq^-1 bq + i.
+// Gqq is factored once and solved against every column of Gqp and bq.
+template <typename Scalar, typename Index>
+BasicPortModel<Scalar, Index>::BasicPortModel(const BasicCircuit<Scalar, Index> &circuit, const vector<Index> &ports)
+    : ports(ports)
+{
+    if (circuit.isOutOfCore())
+        throw logic_error("the conductance matrix was factored out of core and not kept");
+
+    Index numNodes = circuit.getNodeCount();
+    Index systemSize = circuit.getSystemSize();
+    Index numPorts = ports.size();
+    vector<vector<Scalar>> G = circuit.getConductanceMatrix();
+
+    // system row of each port, -1 for internal rows
+    vector<Index> portIndex(systemSize, -1);
+    for (Index k = 0; k < numPorts; k++)
+    {
+        if (ports[k] <= 0 || ports[k] >= numNodes)
+            throw invalid_argument("port " + to_string(ports[k]) + " is not a node of the circuit");
+        if (portIndex[ports[k] - 1] != -1)
+            throw invalid_argument("port " + to_string(ports[k]) + " given twice");
+        portIndex[ports[k] - 1] = k;
+    }
+
+    // a tie to ground in a group holding a port would be a real path from the
+    // port, while the group is open at DC. Ties of other groups only keep Gqq
+    // regular and never reach the ports
+    vector<Index> group = circuit.getDcGroups();
+    for (Index node : circuit.getFloatingNodes())
+    {
+        for (Index port : ports)
+        {
+            if (group[port] == group[node])
+            {
+                G[node - 1][node - 1] -= Scalar(1);
+                break;
+            }
+        }
+    }
+
+    // node numbers nothing connects to are left out
+    vector<Index> internal;
+    for (Index i = 0; i < systemSize; i++)
+    {
+        bool connected = false;
+        for (Index j = 0; j < systemSize && !connected; j++)
+            connected = G[i][j] != Scalar(0) || G[j][i] != Scalar(0);
+        if (portIndex[i] == -1 && connected)
+            internal.push_back(i);
+    }
+    Index numInternal = internal.size();
+
+    vector<vector<Scalar>> Gqq(numInternal, vector<Scalar>(numInternal));
+    for (Index i = 0; i < numInternal; i++)
+    {
+        for (Index j = 0; j < numInternal; j++)
+            Gqq[i][j] = G[internal[i]][internal[j]];
+    }
+    BasicLUFactorization<Scalar> factorization(move(Gqq));
+    if (factorization.singular)
+        throw runtime_error("the network fixes a port voltage, it has no finite port admittance");
+
+    // Gqq^-1 Gqp, one column per port, and Gqq^-1 bq
+    vector<vector<Scalar>> columns;
+    for (Index k = 0; k < numPorts; k++)
+    {
+        vector<Scalar> column(numInternal);
+        for (Index i = 0; i < numInternal; i++)
+            column[i] = G[internal[i]][ports[k] - 1];
+        columns.push_back(factorization.solve(column));
+    }
+    vector<Scalar> bq(numInternal);
+    for (Index i = 0; i < numInternal; i++)
+        bq[i] = circuit.sourceVector[internal[i]];
+    vector<Scalar> reducedSources = factorization.solve(bq);
+
+    admittance.assign(numPorts, vector<Scalar>(numPorts, Scalar(0)));
+    nortonCurrents.assign(numPorts, Scalar(0));
+    for (Index r = 0; r < numPorts; r++)
+    {
+        const vector<Scalar> &row = G[ports[r] - 1];
+        for (Index c = 0; c < numPorts; c++)
+        {
+            Scalar sum = row[ports[c] - 1];
+            for (Index i = 0; i < numInternal; i++)
+                sum -= row[internal[i]] * columns[c][i];
+            admittance[r][c] = sum;
+        }
+
+        Scalar current = circuit.sourceVector[ports[r] - 1];
+        for (Index i = 0; i < numInternal; i++)
+            current -= row[internal[i]] * reducedSources[i];
+        nortonCurrents[r] = current;
+    }
+
+    // with no path from the ports to ground the open-circuit voltages are
+    // not fixed, so there are none
+    if (!BasicLUFactorization<Scalar>(admittance).singular)
+        theveninVoltages = solveWithLoads(typename BasicCircuit<Scalar, Index>::tupleVector());
+}
+
+template <typename Scalar, typename Index>
+vector<Scalar> BasicPortModel<Scalar, Index>::solveWithLoads(const typename BasicCircuit<Scalar, Index>::tupleVector &loads) const
+{
+    int numPorts = ports.size();
+
+    // port number of each node the loads refer to, -1 for ground
+    auto findPort = [this](Index node) {
+        if (node == 0)
+            return -1;
+        for (size_t k = 0; k < ports.size(); k++)
+        {
+            if (ports[k] == node)
+                return (int)k;
+        }
+        throw invalid_argument("load connects to node " + to_string(node) + " which is not a port");
+    };
+
+    // loads draw current out of the ports, which stamps their conductance
+    vector<vector<Scalar>> Y = admittance;
+    for (const tuple<Index, Index, Scalar> &load : loads)
+    {
+        int i = findPort(get<0>(load));
+        int j = findPort(get<1>(load));
+        Scalar conductance = Scalar(1) / get<2>(load);
+
+        if (i >= 0)
+            Y[i][i] += conductance;
+        if (j >= 0)
+            Y[j][j] += conductance;
+        if (i >= 0 && j >= 0)
+        {
+            Y[i][j] -= conductance;
+            Y[j][i] -= conductance;
+        }
+    }
+
+    if (numPorts == 0)
+        return vector<Scalar>();
+    return BasicLUFactorization<Scalar>(Y).solve(nortonCurrents);
+}
+
+template <typename Scalar, typename Index>
+bool BasicPortModel<Scalar, Index>::hasTheveninVoltages() const
+{
+    return theveninVoltages.size() == ports.size();
+}
+
+template <typename Scalar, typename Index>
+vector<Scalar> BasicPortModel<Scalar, Index>::getPortCurrents(const vector<Scalar> &portVoltages) const
+{
+    vector<Scalar> currents(ports.size());
+    for (size_t r = 0; r < ports.size(); r++)
+    {
+        Scalar current = -nortonCurrents[r];
+        for (size_t c = 0; c < ports.size(); c++)
+            current += admittance[r][c] * portVoltages[c];
+        currents[r] = current;
+    }
+    return currents;
+}
+
+template <typename Scalar, typename Index>
+void BasicPortModel<Scalar, Index>::write(ostream &out) const
+{
+    out << setprecision(numeric_limits<typename RealType<Scalar>::type>::max_digits10);
+    out << "port-model 2\n" << ports.size() << " " << hasTheveninVoltages() << "\n";
+    for (size_t r = 0; r < ports.size(); r++)
+    {
+        out << ports[r] << " " << nortonCurrents[r];
+        if (hasTheveninVoltages())
+            out << " " << theveninVoltages[r];
+        for (Scalar value : admittance[r])
+            out << " " << value;
+        out << "\n";
+    }
+}
+
+// restore a model saved with write(), returns false if the data is malformed
+template <typename Scalar, typename Index>
+bool BasicPortModel<Scalar, Index>::read(istream &in)
+{
+    string magic;
+    int version;
+    size_t numPorts;
+    bool thevenin;
+    if (!(in >> magic >> version >> numPorts >> thevenin) || magic != "port-model" || version != 2)
+        return false;
+
+    ports.assign(numPorts, 0);
+    nortonCurrents.assign(numPorts, Scalar(0));
+    theveninVoltages.assign(thevenin ? numPorts : 0, Scalar(0));
+    admittance.assign(numPorts, vector<Scalar>(numPorts, Scalar(0)));
+    for (size_t r = 0; r < numPorts; r++)
+    {
+        if (!(in >> ports[r]) || !readScalar(in, nortonCurrents[r]))
+            return false;
+        if (thevenin && !readScalar(in, theveninVoltages[r]))
+            return false;
+        for (Scalar &value : admittance[r])
+        {
+            if (!readScalar(in, value))
+                return false;
+        }
+    }
+    return true;
+}
+
+template struct BasicPortModel<double, int32_t>;
+#ifdef CIRCUIT_ALL_TYPES
+template struct BasicPortModel<float, int32_t>;
+template struct BasicPortModel<float, int64_t>;
+template struct BasicPortModel<double, int64_t>;
+template struct BasicPortModel<long double, int32_t>;
+template struct BasicPortModel<long double, int64_t>;
+template struct BasicPortModel<complex<double>, int32_t>;
+template struct BasicPortModel<complex<double>, int64_t>;
+#endif
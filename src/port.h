@@ -0,0 +1,61 @@
+#ifndef PORT_H
+#define PORT_H
+
+#include <iostream>
+#include <vector>
+
+#include "circuit.h"
+
+using namespace std;
+
+// Exact equivalent of a circuit as seen from a few of its nodes (the ports).
+//
+// Every other node and every voltage source is eliminated with a Schur
+// complement, leaving the port equation
+//
+//     admittance * v = nortonCurrents + i
+//
+// where v are the port voltages and i the currents pushed into the ports from
+// outside. Once built, attaching loads or reading port quantities costs
+// O(ports^3) instead of a solve of the whole circuit. Templated on the same
+// value and node number types as BasicCircuit, and instantiated for the same.
+template <typename Scalar, typename Index>
+struct BasicPortModel
+{
+    // circuit node of each port
+    vector<Index> ports;
+
+    // port conductance matrix (Norton admittance)
+    vector<vector<Scalar>> admittance;
+
+    // current the network drives into grounded ports
+    vector<Scalar> nortonCurrents;
+
+    // port voltages with nothing attached, empty when some port has no path
+    // to ground through the network, which leaves them undefined
+    vector<Scalar> theveninVoltages;
+
+    BasicPortModel();
+
+    // throws invalid_argument for bad ports, runtime_error if a port voltage
+    // is fixed by the network itself (e.g. by a voltage source) and
+    // logic_error for a circuit solved out of core
+    BasicPortModel(const BasicCircuit<Scalar, Index> &circuit, const vector<Index> &ports);
+
+    // port voltages with resistors (source, destination, resistance)
+    // connected between ports or from a port to ground (node 0), using the
+    // circuit's node numbers
+    vector<Scalar> solveWithLoads(const typename BasicCircuit<Scalar, Index>::tupleVector &loads) const;
+
+    bool hasTheveninVoltages() const;
+
+    // currents pushed into the ports to hold them at the given voltages
+    vector<Scalar> getPortCurrents(const vector<Scalar> &portVoltages) const;
+
+    void write(ostream &out) const;
+    bool read(istream &in);
+};
+
+typedef BasicPortModel<double, int> PortModel;
+
+#endif
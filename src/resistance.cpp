@@ -0,0 +1,78 @@
+#include "resistance.h"
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+using namespace std;
+
+// number of random projections needed to keep pairwise distances between
+// n points within 1 +/- epsilon (Dasgupta and Gupta's bound)
+static int sketchDimension(int numNodes, double epsilon)
+{
+    double denominator = epsilon * epsilon / 2 - epsilon * epsilon * epsilon / 3;
+    return max(1, (int)ceil(4 * log(max(numNodes, 2)) / denominator));
+}
+
+// With unit current injected at a and drawn at b, the effective resistance is
+// the power burned in the resistors, sum g (v_i - v_j)^2 = |W B X (e_a - e_b)|^2
+// where W = diag(sqrt g), B is the resistor incidence matrix and X maps
+// injected currents to node voltages. Projecting W B X onto random +/-1 rows
+// Q keeps these distances, and each row of Q W B X is one solve with
+// B^T W q as the injected currents since X is symmetric.
+ResistanceSketch::ResistanceSketch(const Circuit &circuit, double epsilon, unsigned int seed)
+{
+    if (!circuit.subcircuits.empty())
+        throw invalid_argument("the resistance sketch does not see the resistors inside subcircuits");
+
+    int numNodes = circuit.nodeVoltages.size();
+    int systemSize = circuit.getSystemSize();
+    dimension = sketchDimension(numNodes, epsilon);
+    groups = circuit.getDcGroups();
+    embedding.assign(numNodes, vector<double>(dimension, 0.0));
+
+    const LUFactorization &factorization = circuit.getFactorization();
+    mt19937 generator(seed);
+    bernoulli_distribution coin(0.5);
+    double scale = 1.0 / sqrt((double)dimension);
+
+    for (int row = 0; row < dimension; row++)
+    {
+        vector<double> injection(systemSize, 0.0);
+        for (const tuple<int, int, double> &resistor : circuit.resistors)
+        {
+            double weight = sqrt(1.0 / get<2>(resistor)) * (coin(generator) ? scale : -scale);
+            if (get<0>(resistor) != 0)
+                injection[get<0>(resistor) - 1] += weight;
+            if (get<1>(resistor) != 0)
+                injection[get<1>(resistor) - 1] -= weight;
+        }
+
+        vector<double> x = factorization.solve(injection);
+        for (int node = 1; node < numNodes; node++)
+            embedding[node][row] = x[node - 1];
+    }
+}
+
+double ResistanceSketch::getResistance(int node1, int node2) const
+{
+    if (groups[node1] != groups[node2])
+        return numeric_limits<double>::infinity();
+
+    double resistance = 0.0;
+    for (int i = 0; i < dimension; i++)
+    {
+        double difference = embedding[node1][i] - embedding[node2][i];
+        resistance += difference * difference;
+    }
+    return resistance;
+}
+
+vector<double> ResistanceSketch::getResistancesFrom(int node) const
+{
+    vector<double> resistances(embedding.size());
+    for (unsigned int other = 0; other < embedding.size(); other++)
+        resistances[other] = getResistance(node, other);
+    return resistances;
+}
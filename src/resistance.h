@@ -0,0 +1,39 @@
+#ifndef RESISTANCE_H
+#define RESISTANCE_H
+
+#include <vector>
+
+#include "circuit.h"
+
+using namespace std;
+
+// Approximate effective resistances between all pairs of nodes.
+//
+// Each node is given a short vector such that the squared distance between
+// two nodes' vectors is their effective resistance to within a factor of
+// 1 +/- epsilon with high probability (Johnson-Lindenstrauss). Building it
+// takes O(log n / epsilon^2) solves with the circuit's cached factorization,
+// after which any pair is answered in O(log n / epsilon^2) time.
+struct ResistanceSketch
+{
+    // length of each node's vector
+    int dimension;
+
+    // embedding[node][i], the reference node is all zeros
+    vector<vector<double>> embedding;
+
+    // DC group of each node, see Circuit::getDcGroups(); nodes in different
+    // groups are open to each other and their resistance is infinite
+    vector<int> groups;
+
+    // throws invalid_argument for a circuit with subcircuit instances, whose
+    // internal resistors are not visible to the sketch
+    ResistanceSketch(const Circuit &circuit, double epsilon, unsigned int seed = 1);
+
+    double getResistance(int node1, int node2) const;
+
+    // resistance from one node to every node, e.g. a map of resistance to ground
+    vector<double> getResistancesFrom(int node) const;
+};
+
+#endif
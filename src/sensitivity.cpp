@@ -0,0 +1,94 @@
+#include "sensitivity.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+// The output is c^T x for the MNA solution G x = b. Solving G^T y = c once
+// gives d(output)/dp = y^T (db/dp - dG/dp x) for every parameter p:
+// a resistor stamps g (e_i - e_j)(e_i - e_j)^T into G and a voltage source
+// stamps its voltage into its own row of b.
+Sensitivity::Sensitivity(const Circuit &circuit, const SensitivityOutput &output)
+{
+    if (circuit.isOutOfCore())
+        throw logic_error("the conductance matrix was factored out of core and not kept");
+
+    int numNodes = circuit.nodeVoltages.size();
+    int systemSize = circuit.getSystemSize();
+
+    auto checkNode = [numNodes](int node) {
+        if (node < 0 || node >= numNodes)
+            throw invalid_argument("node " + to_string(node) + " is not a node of the circuit");
+    };
+    if (output.kind == SensitivityOutput::SOURCE_CURRENT)
+    {
+        if (output.node1 < 0 || output.node1 >= (int)circuit.batteries.size())
+            throw invalid_argument("there is no voltage source number " + to_string(output.node1));
+    }
+    else
+    {
+        checkNode(output.node1);
+        if (output.kind == SensitivityOutput::VOLTAGE_DIFFERENCE)
+            checkNode(output.node2);
+
+        // a voltage across groups that only capacitors connect is set by the
+        // ties of getFloatingNodes(), not by the components
+        int node2 = output.kind == SensitivityOutput::VOLTAGE_DIFFERENCE ? output.node2 : 0;
+        vector<int> group = circuit.getDcGroups();
+        if (group[output.node1] != group[node2])
+            throw invalid_argument("node " + to_string(output.node1) + " has no DC path to node " +
+                                   to_string(node2));
+    }
+
+    // solution in system order, node k is row k - 1
+    vector<double> x(systemSize, 0.0);
+    for (int node = 1; node < numNodes; node++)
+        x[node - 1] = circuit.nodeVoltages[node];
+    for (unsigned int k = 0; k < circuit.sourceCurrents.size(); k++)
+        x[numNodes - 1 + k] = circuit.sourceCurrents[k];
+
+    vector<double> c(systemSize, 0.0);
+    switch (output.kind)
+    {
+    case SensitivityOutput::NODE_VOLTAGE:
+        if (output.node1 != 0)
+            c[output.node1 - 1] = 1.0;
+        break;
+    case SensitivityOutput::VOLTAGE_DIFFERENCE:
+        if (output.node1 != 0)
+            c[output.node1 - 1] += 1.0;
+        if (output.node2 != 0)
+            c[output.node2 - 1] -= 1.0;
+        break;
+    case SensitivityOutput::SOURCE_CURRENT:
+        c[numNodes - 1 + output.node1] = 1.0;
+        break;
+    }
+
+    value = 0.0;
+    for (int i = 0; i < systemSize; i++)
+        value += c[i] * x[i];
+
+    vector<double> y = circuit.getFactorization().solveTransposed(c);
+
+    // node voltages and adjoint values with the reference node put back
+    vector<double> v(numNodes, 0.0), adjoint(numNodes, 0.0);
+    for (int node = 1; node < numNodes; node++)
+    {
+        v[node] = x[node - 1];
+        adjoint[node] = y[node - 1];
+    }
+
+    for (const tuple<int, int, double> &resistor : circuit.resistors)
+    {
+        int i = get<0>(resistor);
+        int j = get<1>(resistor);
+        double R = get<2>(resistor);
+
+        // dG/dR = -1/R^2 dG/dg
+        resistors.push_back((adjoint[i] - adjoint[j]) * (v[i] - v[j]) / (R * R));
+    }
+
+    for (unsigned int k = 0; k < circuit.batteries.size(); k++)
+        batteries.push_back(y[numNodes - 1 + k]);
+}
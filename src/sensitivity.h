@@ -0,0 +1,45 @@
+#ifndef SENSITIVITY_H
+#define SENSITIVITY_H
+
+#include <vector>
+
+#include "circuit.h"
+
+using namespace std;
+
+// Value of a solved circuit whose derivatives are wanted
+struct SensitivityOutput
+{
+    enum Kind
+    {
+        NODE_VOLTAGE,       // voltage at node1
+        VOLTAGE_DIFFERENCE, // voltage from node1 to node2
+        SOURCE_CURRENT      // current through voltage source number node1 (0 based)
+    };
+
+    Kind kind;
+    int node1;
+    int node2;
+};
+
+// Derivatives of one output with respect to every resistance and every source
+// voltage, found with the adjoint method: one transposed solve with the
+// circuit's cached factorization, whatever the number of components.
+struct Sensitivity
+{
+    // the output itself
+    double value;
+
+    // d(output)/d(resistance) in resistor order
+    vector<double> resistors;
+
+    // d(output)/d(voltage) in voltage source order
+    vector<double> batteries;
+
+    // throws logic_error for a circuit solved out of core and invalid_argument
+    // for a node or voltage source the circuit does not have, or for nodes
+    // with no DC path between them, whose voltage the components do not fix
+    Sensitivity(const Circuit &circuit, const SensitivityOutput &output);
+};
+
+#endif
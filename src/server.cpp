@@ -0,0 +1,272 @@
+#include "server.h"
+
+#include <atomic>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// set once a client asks the server to stop
+static atomic<bool> stopping(false);
+
+// find a circuit by its index in the list or by its netlist path
+static const Circuit *findCircuit(const circuitList &circuits, const string &name)
+{
+    for (const auto &entry : circuits)
+    {
+        if (entry.first == name)
+            return entry.second.get();
+    }
+
+    // an index too long for stoul is past the end of the list anyway
+    if (!name.empty() && name.size() < 10 && name.find_first_not_of("0123456789") == string::npos)
+    {
+        unsigned long index = stoul(name);
+        if (index < circuits.size())
+            return circuits[index].second.get();
+    }
+    return nullptr;
+}
+
+static bool nodeExists(const Circuit &circuit, int node)
+{
+    return node >= 0 && node < (int)circuit.nodeVoltages.size();
+}
+
+// a resistor or voltage source joins the two nodes, which getCurrentFromPoints needs
+static bool branchExists(const Circuit &circuit, int node1, int node2)
+{
+    for (const Circuit::tupleVector *components : {&circuit.resistors, &circuit.batteries})
+    {
+        for (const auto &component : *components)
+        {
+            int i = get<0>(component), j = get<1>(component);
+            if ((i == node1 && j == node2) || (i == node2 && j == node1))
+                return true;
+        }
+    }
+    return false;
+}
+
+// answer a single request line
+static string handleRequest(const circuitList &circuits, const string &request, bool &closeConnection)
+{
+    istringstream in(request);
+    ostringstream out;
+    out << setprecision(numeric_limits<double>::max_digits10);
+
+    string command;
+    in >> command;
+
+    if (command == "QUIT")
+    {
+        closeConnection = true;
+        return "OK";
+    }
+    if (command == "SHUTDOWN")
+    {
+        stopping = true;
+        closeConnection = true;
+        return "OK";
+    }
+    if (command == "LIST")
+    {
+        out << "OK";
+        for (const auto &entry : circuits)
+            out << " " << entry.first;
+        return out.str();
+    }
+
+    string name;
+    if (!(in >> name))
+        return "ERR missing circuit";
+    const Circuit *circuit = findCircuit(circuits, name);
+    if (circuit == nullptr)
+        return "ERR unknown circuit " + name;
+
+    if (command == "V")
+    {
+        int node;
+        if (!(in >> node))
+            return "ERR expected V <circuit> <node>";
+        if (!nodeExists(*circuit, node))
+            return "ERR node does not exist";
+        out << "OK " << circuit->nodeVoltages[node];
+    }
+    else if (command == "VD")
+    {
+        int node1, node2;
+        if (!(in >> node1 >> node2))
+            return "ERR expected VD <circuit> <node1> <node2>";
+        if (!nodeExists(*circuit, node1) || !nodeExists(*circuit, node2))
+            return "ERR node does not exist";
+        out << "OK " << circuit->getVoltageFromPoints(node1, node2);
+    }
+    else if (command == "R")
+    {
+        int node1, node2;
+        if (!(in >> node1 >> node2))
+            return "ERR expected R <circuit> <node1> <node2>";
+        if (!nodeExists(*circuit, node1) || !nodeExists(*circuit, node2))
+            return "ERR node does not exist";
+        if (circuit->isOutOfCore())
+            return "ERR circuit was solved out of core";
+        out << "OK " << circuit->getEffectiveResistance(node1, node2);
+    }
+    else if (command == "I")
+    {
+        // consecutive nodes a b c ... describe the path [a,b],[b,c],...
+        vector<int> nodes;
+        int node;
+        while (in >> node)
+        {
+            if (!nodeExists(*circuit, node))
+                return "ERR node does not exist";
+            nodes.push_back(node);
+        }
+        if (!in.eof() || nodes.size() < 2)
+            return "ERR expected I <circuit> <node1> <node2> ...";
+
+        vector<pair<int, int>> nodePairs;
+        for (unsigned int i = 0; i + 1 < nodes.size(); i++)
+        {
+            if (!branchExists(*circuit, nodes[i], nodes[i + 1]))
+                return "ERR no resistor between " + to_string(nodes[i]) + " and " + to_string(nodes[i + 1]);
+            nodePairs.push_back({nodes[i], nodes[i + 1]});
+        }
+        out << "OK " << circuit->getCurrentFromPoints(nodePairs);
+    }
+    else if (command == "IALL")
+    {
+        out << "OK";
+        for (const auto &current : circuit->getCurrents())
+            out << " " << current.first << " " << current.second;
+    }
+    else
+    {
+        return "ERR unknown command " + command;
+    }
+    return out.str();
+}
+
+static bool sendLine(int fd, string line)
+{
+    line += '\n';
+    size_t sent = 0;
+    while (sent < line.size())
+    {
+        ssize_t n = send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+static void serveConnection(int fd, const circuitList &circuits)
+{
+    string pending;
+    char buffer[4096];
+    bool closeConnection = false;
+
+    while (!closeConnection)
+    {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+            break;
+        pending.append(buffer, n);
+
+        size_t newline;
+        while (!closeConnection && (newline = pending.find('\n')) != string::npos)
+        {
+            string request = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            if (!request.empty() && request.back() == '\r')
+                request.pop_back();
+            if (request.empty())
+                continue;
+
+            // an exception must not escape the worker thread and end the server
+            string response;
+            try
+            {
+                response = handleRequest(circuits, request, closeConnection);
+            }
+            catch (const exception &e)
+            {
+                response = string("ERR ") + e.what();
+            }
+            if (!sendLine(fd, response))
+                closeConnection = true;
+        }
+    }
+    close(fd);
+}
+
+// every worker accepts connections from the shared listening socket
+static void acceptConnections(int listenFd, const circuitList &circuits)
+{
+    while (!stopping)
+    {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0)
+            break;
+
+        serveConnection(fd, circuits);
+
+        // wake up the other workers blocked in accept()
+        if (stopping)
+            shutdown(listenFd, SHUT_RDWR);
+    }
+}
+
+int runServer(const string &socketPath, const circuitList &circuits, unsigned int numThreads)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        cerr << "Error: socket path too long" << endl;
+        return 1;
+    }
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0)
+    {
+        cerr << "Error: could not create socket" << endl;
+        return 1;
+    }
+
+    unlink(socketPath.c_str());
+    if (bind(listenFd, (sockaddr *)&address, sizeof(address)) < 0 || listen(listenFd, 64) < 0)
+    {
+        cerr << "Error: could not listen on " << socketPath << endl;
+        close(listenFd);
+        return 1;
+    }
+
+    if (numThreads == 0)
+        numThreads = 1;
+    cout << "Serving " << circuits.size() << " circuit(s) on " << socketPath
+         << " with " << numThreads << " thread(s)" << endl;
+
+    vector<thread> workers;
+    for (unsigned int i = 0; i < numThreads; i++)
+        workers.emplace_back(acceptConnections, listenFd, cref(circuits));
+    for (thread &worker : workers)
+        worker.join();
+
+    close(listenFd);
+    unlink(socketPath.c_str());
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+
+using namespace std;
+
+// Loaded circuits served by the query server, named by their netlist path
+typedef vector<pair<string, circuitHandle>> circuitList;
+
+// Serve queries against already solved circuits on a Unix domain socket.
+//
+// The protocol is one request per line and one response per line. Circuits
+// are selected by their index in the list or by their netlist path:
+//
+//   LIST                       -> OK <name0> <name1> ...
+//   V <circuit> <node>         -> OK <voltage>
+//   VD <circuit> <n1> <n2>     -> OK <voltage drop from n1 to n2>
+//   R <circuit> <n1> <n2>      -> OK <effective resistance between n1 and n2>
+//   I <circuit> <a> <b> ...    -> OK <current along path [a,b],[b,c],...>
+//   IALL <circuit>             -> OK <name> <current> <name> <current> ...
+//   QUIT                       -> closes the connection
+//   SHUTDOWN                   -> stops the server
+//
+// Failed requests are answered with "ERR <message>". The circuits are never
+// modified once the server starts, so every worker thread reads them
+// directly without taking a lock.
+int runServer(const string &socketPath, const circuitList &circuits, unsigned int numThreads);
+
+#endif
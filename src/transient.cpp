@@ -0,0 +1,252 @@
+#include "transient.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+// Companion models with step h, where the companion step k is h for backward
+// Euler and h / 2 for the trapezoidal rule:
+//   capacitor: conductance C / k in parallel with a current source
+//              C / k * v_prev (backward Euler) or C / k * v_prev + i_prev
+//   inductor:  branch equation v - L / k * i = -L / k * i_prev (backward
+//              Euler) or -L / k * i_prev - v_prev
+// The DC conductance matrix already holds the resistors, the voltage sources
+// and an inductor branch row, so only the C and L terms are added to it once
+// the ties of its floating nodes are taken out.
+
+TransientAnalysis::TransientAnalysis(const Circuit &circuit)
+    : circuit(circuit), factorizationCount(0)
+{
+    if (!circuit.subcircuits.empty())
+        throw invalid_argument("subcircuits are reduced for DC only and cannot be simulated in time");
+    if (circuit.isOutOfCore())
+        throw logic_error("the conductance matrix was factored out of core and not kept");
+
+    numNodes = circuit.nodeVoltages.size();
+    systemSize = circuit.getSystemSize();
+    floatingNodes = circuit.getFloatingNodes();
+}
+
+int TransientAnalysis::getFactorizationCount() const
+{
+    return factorizationCount;
+}
+
+const LUFactorization &TransientAnalysis::getFactorization(double companionStep)
+{
+    for (auto it = factorizations.begin(); it != factorizations.end(); ++it)
+    {
+        if (it->first == companionStep)
+        {
+            factorizations.splice(factorizations.begin(), factorizations, it);
+            return it->second;
+        }
+    }
+
+    vector<vector<double>> A = circuit.getConductanceMatrix();
+    for (int node : floatingNodes)
+        A[node - 1][node - 1] -= 1.0;
+    for (const tuple<int, int, double> &capacitor : circuit.capacitors)
+    {
+        int i = get<0>(capacitor);
+        int j = get<1>(capacitor);
+        double conductance = get<2>(capacitor) / companionStep;
+
+        if (i != 0)
+            A[i - 1][i - 1] += conductance;
+        if (j != 0)
+            A[j - 1][j - 1] += conductance;
+        if (i != 0 && j != 0)
+        {
+            A[i - 1][j - 1] -= conductance;
+            A[j - 1][i - 1] -= conductance;
+        }
+    }
+
+    int row = numNodes - 1 + circuit.batteries.size();
+    for (const tuple<int, int, double> &inductor : circuit.inductors)
+    {
+        A[row][row] -= get<2>(inductor) / companionStep;
+        row++;
+    }
+
+    factorizationCount++;
+    if (factorizations.size() >= maxFactorizations)
+        factorizations.pop_back();
+    factorizations.emplace_front(companionStep, LUFactorization(move(A)));
+    return factorizations.front().second;
+}
+
+double TransientAnalysis::nodeVoltage(const vector<double> &x, int node) const
+{
+    return node == 0 ? 0.0 : x[node - 1];
+}
+
+vector<double> TransientAnalysis::step(const vector<double> &previous, const vector<double> &capacitorCurrents,
+                                       double step, IntegrationMethod method)
+{
+    double companionStep = method == TRAPEZOIDAL ? step / 2 : step;
+    vector<double> rhs = circuit.sourceVector;
+
+    for (unsigned int k = 0; k < circuit.capacitors.size(); k++)
+    {
+        int i = get<0>(circuit.capacitors[k]);
+        int j = get<1>(circuit.capacitors[k]);
+        double conductance = get<2>(circuit.capacitors[k]) / companionStep;
+
+        double current = conductance * (nodeVoltage(previous, i) - nodeVoltage(previous, j));
+        if (method == TRAPEZOIDAL)
+            current += capacitorCurrents[k];
+
+        if (i != 0)
+            rhs[i - 1] += current;
+        if (j != 0)
+            rhs[j - 1] -= current;
+    }
+
+    int row = numNodes - 1 + circuit.batteries.size();
+    for (const tuple<int, int, double> &inductor : circuit.inductors)
+    {
+        rhs[row] = -get<2>(inductor) / companionStep * previous[row];
+        if (method == TRAPEZOIDAL)
+            rhs[row] -= nodeVoltage(previous, get<0>(inductor)) - nodeVoltage(previous, get<1>(inductor));
+        row++;
+    }
+
+    return getFactorization(companionStep).solve(rhs);
+}
+
+// capacitor currents at the end of a step, needed by the next trapezoidal step
+vector<double> TransientAnalysis::getCapacitorCurrents(const vector<double> &previous, const vector<double> &current,
+                                                       const vector<double> &capacitorCurrents, double step,
+                                                       IntegrationMethod method) const
+{
+    double companionStep = method == TRAPEZOIDAL ? step / 2 : step;
+    vector<double> currents(circuit.capacitors.size());
+
+    for (unsigned int k = 0; k < circuit.capacitors.size(); k++)
+    {
+        int i = get<0>(circuit.capacitors[k]);
+        int j = get<1>(circuit.capacitors[k]);
+        double conductance = get<2>(circuit.capacitors[k]) / companionStep;
+
+        double change = (nodeVoltage(current, i) - nodeVoltage(current, j)) -
+                        (nodeVoltage(previous, i) - nodeVoltage(previous, j));
+        currents[k] = conductance * change;
+        if (method == TRAPEZOIDAL)
+            currents[k] -= capacitorCurrents[k];
+    }
+    return currents;
+}
+
+void TransientAnalysis::writeHeader(ostream &out) const
+{
+    out << "time";
+    for (int node = 1; node < numNodes; node++)
+        out << ",V(" << node << ")";
+    for (unsigned int k = 0; k < circuit.batteries.size(); k++)
+        out << ",I(V" << k + 1 << ")";
+    for (unsigned int k = 0; k < circuit.inductors.size(); k++)
+        out << ",I(L" << k + 1 << ")";
+    out << "\n";
+}
+
+void TransientAnalysis::writeRow(ostream &out, double time, const vector<double> &x) const
+{
+    out << time;
+    for (double value : x)
+        out << "," << value;
+    out << "\n";
+}
+
+void TransientAnalysis::run(const TransientOptions &options, ostream &out)
+{
+    factorizations.clear();
+    factorizationCount = 0;
+
+    bool adaptive = options.tolerance > 0;
+    double maxTimeStep = max(options.maxTimeStep, options.timeStep);
+    double minTimeStep = options.timeStep / (1 << 20);
+
+    out << setprecision(numeric_limits<double>::max_digits10);
+    writeHeader(out);
+
+    // the DC solution in system order, or the de-energized state; either way
+    // no current flows into the capacitors at t = 0
+    vector<double> x(systemSize, 0.0);
+    if (options.fromOperatingPoint)
+    {
+        copy(circuit.nodeVoltages.begin() + 1, circuit.nodeVoltages.end(), x.begin());
+        copy(circuit.sourceCurrents.begin(), circuit.sourceCurrents.end(), x.begin() + numNodes - 1);
+        copy(circuit.inductorCurrents.begin(), circuit.inductorCurrents.end(),
+             x.begin() + numNodes - 1 + circuit.sourceCurrents.size());
+    }
+    vector<double> capacitorCurrents(circuit.capacitors.size(), 0.0);
+    writeRow(out, 0.0, x);
+
+    // sources switching on make a jump at t = 0, after which a trapezoidal
+    // run needs the capacitor currents, so it is started with a backward
+    // Euler step of half the size
+    bool jump = !options.fromOperatingPoint;
+    double h = options.timeStep;
+    if (jump && options.method == TRAPEZOIDAL)
+    {
+        double firstStep = min(h / 2, options.stopTime);
+        vector<double> next = step(x, capacitorCurrents, firstStep, BACKWARD_EULER);
+        capacitorCurrents = getCapacitorCurrents(x, next, capacitorCurrents, firstStep, BACKWARD_EULER);
+        x = next;
+        writeRow(out, firstStep, x);
+    }
+
+    double time = jump && options.method == TRAPEZOIDAL ? min(h / 2, options.stopTime) : 0.0;
+
+    // a jump at t = 0 says nothing about the error, so the error is only
+    // estimated once there are two points after it
+    vector<double> older;
+    double previousStep = 0;
+    bool havePredictor = false;
+    int pointsAfterJump = !jump || options.method == TRAPEZOIDAL ? 1 : 0;
+
+    while (time < options.stopTime)
+    {
+        // a last step within rounding of h is taken as h so it reuses h's factorization
+        double remaining = options.stopTime - time;
+        double stepSize = remaining < h * (1 - 1e-9) ? remaining : h;
+        vector<double> next = step(x, capacitorCurrents, stepSize, options.method);
+
+        if (adaptive && havePredictor)
+        {
+            // local error estimated from how far the solution strays from a
+            // straight line through the last two points
+            double error = 0;
+            for (int i = 0; i < systemSize; i++)
+            {
+                double predicted = x[i] + (x[i] - older[i]) * stepSize / previousStep;
+                error = max(error, fabs(next[i] - predicted));
+            }
+
+            if (error > options.tolerance && h / 2 >= minTimeStep)
+            {
+                h /= 2;
+                continue;
+            }
+            if (error < options.tolerance / 4 && h * 2 <= maxTimeStep)
+                h *= 2;
+        }
+
+        capacitorCurrents = getCapacitorCurrents(x, next, capacitorCurrents, stepSize, options.method);
+        havePredictor = pointsAfterJump > 0;
+        older = x;
+        x = next;
+        pointsAfterJump++;
+        previousStep = stepSize;
+        time += stepSize;
+        if (fabs(options.stopTime - time) < h * 1e-9)
+            time = options.stopTime;
+        writeRow(out, time, x);
+    }
+}
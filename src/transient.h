@@ -0,0 +1,80 @@
+#ifndef TRANSIENT_H
+#define TRANSIENT_H
+
+#include <iostream>
+#include <list>
+#include <utility>
+#include <vector>
+
+#include "circuit.h"
+#include "lu.h"
+
+using namespace std;
+
+enum IntegrationMethod
+{
+    BACKWARD_EULER,
+    TRAPEZOIDAL
+};
+
+struct TransientOptions
+{
+    double stopTime;
+    double timeStep;     // initial step, and the base of every adaptive step
+    double maxTimeStep;  // adaptive steps never grow past this
+    double tolerance;    // largest local error in V or A, 0 for fixed steps
+    IntegrationMethod method;
+    bool fromOperatingPoint; // start from the DC solution instead of a de-energized circuit
+};
+
+// Time-domain simulation of a circuit with capacitors and inductors.
+//
+// The circuit starts either from its DC operating point, where it stays
+// since the sources are constant, or de-energized (capacitors discharged, no
+// inductor current) with its sources switching on at t = 0. Every capacitor
+// and inductor is replaced by its companion model for the integration method,
+// so each step is a linear solve with a matrix that only depends on the step
+// size. That matrix is factored once per distinct step size and every step
+// after that is a pair of triangular solves. Adaptive steps are the initial step times a power of
+// two, so halving and doubling keep landing on factorizations already made,
+// of which the few most recently used are kept.
+// A trapezoidal step of h uses the same matrix as a backward Euler step of
+// h / 2, which is how the first trapezoidal step is started.
+class TransientAnalysis
+{
+public:
+    // throws invalid_argument for a circuit with subcircuit instances, whose
+    // capacitors and inductors are lost when they are reduced for DC, and
+    // logic_error for a circuit solved out of core
+    TransientAnalysis(const Circuit &circuit);
+
+    // simulate and write one CSV row per accepted step as soon as it is known:
+    // time, every node voltage, every voltage source and inductor current
+    void run(const TransientOptions &options, ostream &out);
+
+    // number of matrix factorizations made by the last run
+    int getFactorizationCount() const;
+
+private:
+    const Circuit &circuit;
+    vector<int> floatingNodes; // tied to ground in the DC matrix only
+    int numNodes;
+    int systemSize;
+    int factorizationCount;
+    // by companion step, most recently used first; an adaptive run can visit
+    // many step sizes, so only the last few factorizations are kept
+    list<pair<double, LUFactorization>> factorizations;
+    static const size_t maxFactorizations = 4;
+
+    const LUFactorization &getFactorization(double companionStep);
+    vector<double> step(const vector<double> &previous, const vector<double> &capacitorCurrents,
+                        double step, IntegrationMethod method);
+    vector<double> getCapacitorCurrents(const vector<double> &previous, const vector<double> &current,
+                                        const vector<double> &capacitorCurrents, double step,
+                                        IntegrationMethod method) const;
+    double nodeVoltage(const vector<double> &x, int node) const;
+    void writeHeader(ostream &out) const;
+    void writeRow(ostream &out, double time, const vector<double> &x) const;
+};
+
+#endif
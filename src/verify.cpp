@@ -0,0 +1,105 @@
+#include "verify.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "port.h"
+
+using namespace std;
+
+// a NaN residual is worse than any number and stays the worst
+static bool isWorse(double residual, double worst)
+{
+    return residual > worst || (isnan(residual) && !isnan(worst));
+}
+
+SolutionCheck::SolutionCheck(const Circuit &circuit)
+    : maxCurrentResidual(0), relativeCurrentResidual(0), worstNode(0), maxVoltageResidual(0),
+      relativeVoltageResidual(0), worstSource(0)
+{
+    const vector<double> &v = circuit.nodeVoltages;
+    int numNodes = v.size();
+
+    // sum and scale of the currents leaving each node
+    vector<double> residuals(numNodes, 0.0);
+    vector<double> scales(numNodes, 0.0);
+    auto leave = [&](int node, double current) {
+        residuals[node] += current;
+        scales[node] += fabs(current);
+    };
+
+    for (size_t i = 0; i < circuit.resistors.size(); i++)
+    {
+        double current = circuit.getResistorCurrent(i);
+        leave(get<0>(circuit.resistors[i]), current);
+        leave(get<1>(circuit.resistors[i]), -current);
+    }
+
+    // a source or inductor current flows from its first node through it
+    const Circuit::tupleVector *sources[] = {&circuit.batteries, &circuit.inductors};
+    const vector<double> *currents[] = {&circuit.sourceCurrents, &circuit.inductorCurrents};
+    double maxVoltage = 0;
+    int source = 0;
+    for (int kind = 0; kind < 2; kind++)
+    {
+        for (size_t k = 0; k < sources[kind]->size(); k++, source++)
+        {
+            const tuple<int, int, double> &component = (*sources[kind])[k];
+            int i = get<0>(component), j = get<1>(component);
+            double current = (*currents[kind])[k];
+            leave(i, current);
+            leave(j, -current);
+
+            // an inductor is a 0 V source at DC
+            double value = kind == 0 ? get<2>(component) : 0.0;
+            double residual = fabs(v[i] - v[j] - value);
+            maxVoltage = max(maxVoltage, fabs(value));
+            if (isWorse(residual, maxVoltageResidual))
+            {
+                maxVoltageResidual = residual;
+                worstSource = source;
+            }
+        }
+    }
+
+    for (const Circuit::SubcircuitInstance &instance : circuit.subcircuits)
+    {
+        const PortModel &model = *instance.model;
+        for (size_t a = 0; a < instance.nodes.size(); a++)
+        {
+            double current = -model.nortonCurrents[a];
+            for (size_t b = 0; b < instance.nodes.size(); b++)
+                current += model.admittance[a][b] * v[instance.nodes[b]];
+            leave(instance.nodes[a], current);
+        }
+    }
+
+    // the reference node's equation is implied by all the others
+    double maxScale = 0;
+    for (int node = 1; node < numNodes; node++)
+    {
+        maxScale = max(maxScale, scales[node]);
+        maxVoltage = max(maxVoltage, fabs(v[node]));
+        double residual = fabs(residuals[node]);
+        if (isWorse(residual, maxCurrentResidual))
+        {
+            maxCurrentResidual = residual;
+            worstNode = node;
+        }
+    }
+
+    if (maxScale > 0 || !isfinite(maxCurrentResidual))
+        relativeCurrentResidual = maxCurrentResidual / maxScale;
+    if (maxVoltage > 0 || !isfinite(maxVoltageResidual))
+        relativeVoltageResidual = maxVoltageResidual / maxVoltage;
+}
+
+bool SolutionCheck::isFinite() const
+{
+    return isfinite(relativeCurrentResidual) && isfinite(relativeVoltageResidual);
+}
+
+bool SolutionCheck::passed(double tolerance) const
+{
+    return relativeCurrentResidual <= tolerance && relativeVoltageResidual <= tolerance;
+}
@@ -0,0 +1,35 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "circuit.h"
+
+using namespace std;
+
+// How well a solved circuit satisfies Kirchhoff's laws, found in one pass over
+// the components. The current residual of a node is the sum of the currents
+// leaving it through resistors, voltage sources, inductors and subcircuit
+// ports, which is 0 for an exact solution; the voltage residual of a voltage
+// source (or inductor, a 0 V source at DC) is how far the voltage between its
+// nodes is from its value. Relative residuals divide by the largest current
+// through any node and the largest voltage in the circuit. A solution with
+// NaN or inf gives NaN or inf residuals.
+struct SolutionCheck
+{
+    double maxCurrentResidual; // amperes
+    double relativeCurrentResidual;
+    int worstNode;
+
+    double maxVoltageResidual; // volts
+    double relativeVoltageResidual;
+    int worstSource; // voltage sources first, then inductors, 0 based
+
+    SolutionCheck(const Circuit &circuit);
+
+    // both residuals are finite, false when the solve failed
+    bool isFinite() const;
+
+    // both relative residuals are finite and within tolerance
+    bool passed(double tolerance = 1e-9) const;
+};
+
+#endif